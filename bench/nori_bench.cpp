@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "../src/api.hpp"
+#include "../src/compile.hpp"
+#include "../src/parse/parse.hpp"
+#include "../src/parse/tokens.hpp"
+#include "../src/vm/random.hpp"
+
+namespace {
+
+// Every workload is generated from this seed, so runs on different machines and versions measure the same thing
+constexpr std::uint64_t workload_seed = 0x6e6f7269;
+
+struct Benchmark {
+	std::string name;
+	// MB/s and Miter/s are throughputs, ns/run is a latency
+	std::string_view unit;
+	bool higher_is_better;
+	// Amount of work one run does, in the unit's numerator (bytes, iterations or runs)
+	double work;
+	std::function<void()> run;
+};
+
+struct Result {
+	std::string name;
+	std::string unit;
+	bool higher_is_better;
+	double value;
+	std::vector<double> samples;
+};
+
+// Random but well formed source, covering every kind of token. Loops nest at most four deep and there are fewer
+// variables than the compiler's limit.
+std::string
+generate_source(std::size_t size) {
+	nori::vm::Rng rng{};
+	rng.seed(workload_seed);
+	auto const pick = [&](std::uint64_t n) { return rng() % n; };
+
+	constexpr std::string_view symbols = "<NIO,.@$v:+-/*^zcf%rbB";
+	std::string source{};
+	int depth = 0;
+	while (source.size() < size || depth > 0) {
+		switch (pick(10)) {
+		case 0:
+		case 1:
+		case 2: source += symbols[pick(symbols.size())]; break;
+		case 3: source += fmt::format(">{} ", pick(1000)); break;
+		case 4: source += fmt::format(">F{}.{} ", pick(100), pick(100)); break;
+		case 5: source += fmt::format(">'string {}' ", pick(1000)); break;
+		case 6: source += fmt::format("|var {}|{} ", pick(200), pick(10)); break;
+		case 7: source += fmt::format("~~ comment {} ~~ ", pick(1000)); break;
+		case 8:
+			if (depth < 4 && source.size() < size) {
+				source += '[';
+				++depth;
+			} else if (depth > 0) {
+				source += ']';
+				--depth;
+			}
+			break;
+		case 9:
+			if (depth > 0) {
+				source += ']';
+				--depth;
+			} else {
+				source += fmt::format(">|var {}| ", pick(200));
+			}
+			break;
+		}
+	}
+	return source;
+}
+
+std::string
+compile_program(std::string_view source) {
+	std::stringstream out{};
+	compile(source, out);
+	return std::move(out).str();
+}
+
+// A VM workload. `iterations` is how many times the program's main loop runs.
+Benchmark
+vm_benchmark(std::string name, std::string_view source, double iterations) {
+	auto bytecode = compile_program(source);
+	return Benchmark{
+	    .name = std::move(name),
+	    .unit = "Miter/s",
+	    .higher_is_better = true,
+	    .work = iterations,
+	    .run = [bytecode = std::move(bytecode)] {
+		    auto const result = run_memory(bytecode, "", RunOptions{.seed = workload_seed});
+		    if (result.status != 0)
+			    throw std::runtime_error{result.error};
+	    }};
+}
+
+std::vector<Benchmark>
+benchmarks() {
+	std::vector<Benchmark> list{};
+
+	auto const source = std::make_shared<std::string const>(generate_source(4 << 20));
+	double const source_size = source->size();
+
+	list.emplace_back(Benchmark{
+	    .name = "tokenize",
+	    .unit = "MB/s",
+	    .higher_is_better = true,
+	    .work = source_size,
+	    .run = [source] {
+		    std::string_view const view{*source};
+		    std::size_t count = 0;
+		    for (auto const &tok : nori::parse::Tokens{view})
+			    count += static_cast<std::size_t>(tok.type);
+		    if (count == 0)
+			    throw std::runtime_error{"No tokens"};
+	    }});
+
+	list.emplace_back(Benchmark{
+	    .name = "parse",
+	    .unit = "MB/s",
+	    .higher_is_better = true,
+	    .work = source_size,
+	    .run = [source] {
+		    std::string_view const view{*source};
+		    nori::parse::Tokens toks{view};
+		    auto iter = std::begin(toks);
+		    auto const ast = nori::parse::parse(iter, std::end(toks));
+		    if (ast.nodes.empty())
+			    throw std::runtime_error{"Empty AST"};
+	    }});
+
+	list.emplace_back(Benchmark{
+	    .name = "compile",
+	    .unit = "MB/s",
+	    .higher_is_better = true,
+	    .work = source_size,
+	    .run = [source] {
+		    if (compile_program(*source).empty())
+			    throw std::runtime_error{"No bytecode"};
+	    }});
+
+	list.emplace_back(Benchmark{
+	    .name = "compile_stream",
+	    .unit = "MB/s",
+	    .higher_is_better = true,
+	    .work = source_size,
+	    .run = [source] {
+		    std::istringstream in{*source};
+		    std::stringstream out{};
+		    compile_stream(in, out);
+		    if (out.tellp() <= 0)
+			    throw std::runtime_error{"No bytecode"};
+	    }});
+
+	constexpr int loops = 200'000;
+	list.emplace_back(vm_benchmark("vm_arithmetic", fmt::format(">{} [>1 - : >3 * >7 % >2 ^ >5 / f <]", loops), loops));
+	list.emplace_back(vm_benchmark("vm_string_output", fmt::format(">{} [>'hello, world' O >1 -]", loops), loops));
+	list.emplace_back(vm_benchmark(
+	    "vm_variables", fmt::format("|n|{} |step|1 >|n| [< >|n| >|step| - |n|< >|n| |last|< >|last|]", loops), loops));
+	// Grows the stack to `loops` values, then pops them all again
+	list.emplace_back(vm_benchmark("vm_deep_stack", fmt::format(">0 >{} [: >1 -] < [<]", loops), 2.0 * loops));
+	// 64 values under the counter, each iteration buries a new one and reverses the whole stack twice
+	constexpr int rotations = 20'000;
+	std::string rotate{};
+	for (int i = 0; i < 64; ++i)
+		rotate += fmt::format(">{} ", i);
+	rotate += fmt::format(">{} [>1 - >7 v $ $]", rotations);
+	list.emplace_back(vm_benchmark("vm_reverse_bury", rotate, rotations));
+
+	// The same numbers summed with the bulk ops, counted per value
+	list.emplace_back(vm_benchmark("vm_bulk", fmt::format(">0 >{} R >3 A* >1 A+ S <", loops), loops));
+
+	constexpr int starts = 20'000;
+	list.emplace_back(Benchmark{
+	    .name = "vm_startup",
+	    .unit = "ns/run",
+	    .higher_is_better = false,
+	    .work = starts,
+	    .run = [bytecode = compile_program(">1 O")] {
+		    for (int i = 0; i < starts; ++i) {
+			    if (run_memory(bytecode).status != 0)
+				    throw std::runtime_error{"Startup program failed"};
+		    }
+	    }});
+
+	// Runs that fail straight away, which is most of them when the programs are fuzzed
+	list.emplace_back(Benchmark{
+	    .name = "vm_failure",
+	    .unit = "ns/run",
+	    .higher_is_better = false,
+	    .work = starts,
+	    .run = [bytecode = compile_program(">1 >'a' +")] {
+		    for (int i = 0; i < starts; ++i) {
+			    if (run_memory(bytecode).status != 1)
+				    throw std::runtime_error{"Failing program didn't fail"};
+		    }
+	    }});
+
+	return list;
+}
+
+Result
+measure(Benchmark const &bench, int repeat) {
+	// One untimed run to warm caches and the VM pool
+	bench.run();
+
+	Result result{.name = bench.name, .unit = std::string{bench.unit}, .higher_is_better = bench.higher_is_better};
+	for (int i = 0; i < repeat; ++i) {
+		auto const start = std::chrono::steady_clock::now();
+		bench.run();
+		std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+		double const seconds = std::max(elapsed.count(), 1e-9);
+		result.samples.emplace_back(bench.higher_is_better ? bench.work / 1e6 / seconds : seconds * 1e9 / bench.work);
+	}
+
+	auto sorted = result.samples;
+	std::sort(sorted.begin(), sorted.end());
+	result.value = sorted[sorted.size() / 2];
+	return result;
+}
+
+std::string
+to_json(std::vector<Result> const &results) {
+	// One result per line, which is all read_baseline relies on
+	std::string json = fmt::format("{{\n  \"compiler_version\": \"{}\",\n  \"results\": [\n", nori::compiler_version);
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		auto const &result = results[i];
+		std::string samples{};
+		for (auto const sample : result.samples)
+			samples += fmt::format("{}{:.3f}", samples.empty() ? "" : ", ", sample);
+		json += fmt::format(
+		    "    {{\"name\": \"{}\", \"unit\": \"{}\", \"higher_is_better\": {}, \"value\": {:.3f}, "
+		    "\"samples\": [{}]}}{}\n",
+		    result.name, result.unit, result.higher_is_better, result.value, samples,
+		    i + 1 == results.size() ? "" : ",");
+	}
+	json += "  ]\n}\n";
+	return json;
+}
+
+// Reads the name and value of each result from a file written by to_json
+std::optional<std::map<std::string, double>>
+read_baseline(std::string const &filename) {
+	std::ifstream fs{filename};
+	if (!fs) {
+		fmt::print(stderr, "Couldn't open {}\n", filename);
+		return std::nullopt;
+	}
+
+	std::map<std::string, double> values{};
+	constexpr std::string_view name_key = "\"name\": \"";
+	constexpr std::string_view value_key = "\"value\": ";
+	for (std::string line; std::getline(fs, line);) {
+		auto const name_at = line.find(name_key);
+		auto const value_at = line.find(value_key);
+		if (name_at == std::string::npos || value_at == std::string::npos)
+			continue;
+
+		auto const name_begin = name_at + name_key.size();
+		auto const name = line.substr(name_begin, line.find('"', name_begin) - name_begin);
+		auto const value_begin = line.data() + value_at + value_key.size();
+		double value;
+		if (std::from_chars(value_begin, line.data() + line.size(), value).ec == std::errc{})
+			values[name] = value;
+	}
+	return values;
+}
+
+// Prints how each result moved against the baseline, returning whether any got worse by more than `threshold` percent
+bool
+compare(std::vector<Result> const &results, std::map<std::string, double> const &baseline, double threshold) {
+	bool regressed = false;
+	for (auto const &result : results) {
+		auto const found = baseline.find(result.name);
+		if (found == baseline.end() || found->second == 0) {
+			fmt::print(stderr, "{:<18} {:>12.3f} {:<8} (no baseline)\n", result.name, result.value, result.unit);
+			continue;
+		}
+
+		// Positive is an improvement whichever way the unit goes
+		double change = (result.value - found->second) / found->second * 100;
+		if (!result.higher_is_better)
+			change = -change;
+		bool const worse = change < -threshold;
+		regressed = regressed || worse;
+		fmt::print(
+		    stderr, "{:<18} {:>12.3f} {:<8} {:>+7.1f}%{}\n", result.name, result.value, result.unit, change,
+		    worse ? "  REGRESSION" : "");
+	}
+	return regressed;
+}
+
+template <class N>
+bool
+parse_positive(std::string_view flag, std::string_view value, N &out) {
+	auto const [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+	if (ec != std::errc{} || ptr != value.data() + value.size() || out <= 0) {
+		fmt::print(stderr, "Invalid value for {}: {}\n", flag, value);
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+int
+main(int argc, char const **argv) {
+	std::string filter{};
+	std::string output{};
+	std::string baseline_file{};
+	int repeat = 5;
+	double threshold = 10;
+
+	std::map<std::string_view, std::string *> const flags{
+	    {"--filter", &filter}, {"--output", &output}, {"--baseline", &baseline_file}};
+	std::string repeat_arg{};
+	std::string threshold_arg{};
+	for (int i = 1; i < argc; ++i) {
+		std::string_view const arg{argv[i]};
+		std::string *target = arg == "--repeat" ? &repeat_arg : arg == "--threshold" ? &threshold_arg : nullptr;
+		if (auto const found = flags.find(arg); found != flags.end())
+			target = found->second;
+		if (!target) {
+			fmt::print(
+			    stderr, "Usage: nori_bench [--filter name] [--repeat n] [--output file.json] [--baseline file.json] "
+			            "[--threshold percent]\n");
+			return 1;
+		}
+		if (++i == argc) {
+			fmt::print(stderr, "{} requires a value\n", arg);
+			return 1;
+		}
+		*target = argv[i];
+	}
+
+	if (!repeat_arg.empty() && !parse_positive("--repeat", repeat_arg, repeat))
+		return 1;
+	if (!threshold_arg.empty() && !parse_positive("--threshold", threshold_arg, threshold))
+		return 1;
+
+	std::optional<std::map<std::string, double>> baseline{};
+	if (!baseline_file.empty() && !(baseline = read_baseline(baseline_file)))
+		return 1;
+
+	std::vector<Result> results{};
+	try {
+		for (auto const &bench : benchmarks()) {
+			if (bench.name.find(filter) == std::string::npos)
+				continue;
+			auto const &result = results.emplace_back(measure(bench, repeat));
+			if (!baseline)
+				fmt::print(stderr, "{:<18} {:>12.3f} {}\n", result.name, result.value, result.unit);
+		}
+	} catch (std::exception const &err) {
+		fmt::print(stderr, "Benchmark failed: {}\n", err.what());
+		return 1;
+	}
+
+	auto const json = to_json(results);
+	if (output.empty()) {
+		fmt::print("{}", json);
+	} else {
+		std::ofstream fs{output, std::ios_base::trunc};
+		fs << json;
+	}
+
+	if (baseline && compare(results, *baseline, threshold))
+		return 2;
+	return 0;
+}
@@ -1,25 +1,386 @@
+#include <chrono>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "api.hpp"
 #include "compile.hpp"
+#include "memstream.hpp"
 #include "parse/parse.hpp"
 #include "parse/tokenio.hpp"
 #include "parse/tokens.hpp"
+#include "result_cache.hpp"
+#include "thread_pool.hpp"
+#include "vm/bytecode.hpp"
+#include "vm/pool.hpp"
+#include "vm/profiler.hpp"
+#include "vm/recording.hpp"
+#include "vm/sampler.hpp"
+#include "vm/trace.hpp"
 #include "vm/vm.hpp"
 
-int
-run_stream(std::istream &program, std::ostream &output, std::istream& input) {
-	nori::vm::VM vm{program, 255, output, input};
+namespace {
+
+struct Failure {
+	int status;
+	std::string message;
+};
+
+// Calls `run`, which runs `vm` and returns how it stopped, turning a failed run into a Failure. Program errors come
+// back from the VM as a status, only things like a bad snapshot are thrown.
+template <class V, class F>
+std::optional<Failure>
+check_failure(V const &vm, F &&run) {
+	nori::vm::ExecStatus status;
 	try {
-		vm.exec();
-		return 0;
-	} catch (nori::vm::InvalidOperandException) {
-		std::cerr << "Attempted to operate on two invalid operands" << std::endl;
-		return 1;
-	} catch (nori::vm::StackException) {
-		std::cerr << "Stack doesn't contain enough elements" << std::endl;
-		return 1;
-	} catch (std::runtime_error err) {
-		std::cerr << err.what() << std::endl;
-		return 1;
+		status = run();
+	} catch (std::runtime_error const &err) {
+		return Failure{1, err.what()};
+	}
+	if (status != nori::vm::ExecStatus::Failed)
+		return std::nullopt;
+	auto const &error = vm.error();
+	return Failure{is_limit(error.kind) ? limit_exceeded_status : 1, nori::vm::error_message(error)};
+}
+
+// Runs the program the VM was reset with
+template <class V>
+std::optional<Failure>
+exec(V &vm, RunOptions const &options) {
+	if (options.seed)
+		vm.seed(*options.seed, options.stream);
+	if (options.record)
+		vm.record_input(&options.record->input);
+	if (!options.restore.empty()) {
+		return check_failure(vm, [&] {
+			vm.restore(options.restore);
+			return vm.resume();
+		});
+	}
+	return check_failure(vm, [&] { return vm.exec(); });
+}
+
+template <class O, class T>
+std::optional<Failure>
+exec_on_own_vm(T &program, std::ostream &output, std::istream &input, RunOptions const &options, O &observer) {
+	nori::vm::VM<T, nori::vm::Rng, O> vm{255};
+	// Hooked in before reset(), which already loads bytecode
+	vm.observer() = std::move(observer);
+	vm.reset(program, output, input);
+	auto error = exec(vm, options);
+	observer = std::move(vm.observer());
+	return error;
+}
+
+// Runs on a VM of its own with `observer` hooked in, the pooled VMs are built without any hooks
+template <class O, class T>
+std::optional<Failure>
+exec_observed(T &program, std::ostream &output, std::istream &input, RunOptions const &options, O &observer) {
+	if (options.limits.any()) {
+		nori::vm::Limiter<O> limiter{options.limits, &observer};
+		return exec_on_own_vm(program, output, input, options, limiter);
+	}
+	return exec_on_own_vm(program, output, input, options, observer);
+}
+
+template <class T>
+std::optional<Failure>
+run(T &program, std::ostream &output, std::istream &input, RunOptions const &options) {
+	if (options.record) {
+		if (!options.seed) {
+			// The recording needs to know the seed
+			auto seeded = options;
+			std::random_device device;
+			seeded.seed = (std::uint64_t{device()} << 32) | device();
+			return run(program, output, input, seeded);
+		}
+		options.record->seed = *options.seed;
+		options.record->stream = options.stream;
+		options.record->input.clear();
+	}
+
+	if (options.profiler)
+		return exec_observed(program, output, input, options, *options.profiler);
+
+	if (options.sampler) {
+		auto probe = options.sampler->probe();
+		nori::vm::Sampler::Running const running{*options.sampler};
+		return exec_observed(program, output, input, options, probe);
+	}
+
+	if (options.stats) {
+		options.stats->vm = {};
+		auto const start = std::chrono::steady_clock::now();
+		auto error = exec_observed(program, output, input, options, options.stats->vm);
+		options.stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return error;
+	}
+
+	if (options.tracer) {
+		auto error = exec_observed(program, output, input, options, *options.tracer);
+		options.tracer->finish();
+		return error;
+	}
+
+	if (options.limits.any()) {
+		thread_local nori::vm::Pool<nori::vm::VM<T, nori::vm::Rng, nori::vm::Limiter<>>> limited_pool{255};
+
+		auto vm = limited_pool.acquire();
+		vm->observer() = nori::vm::Limiter<>{options.limits};
+		vm->reset(program, output, input);
+		return exec(*vm, options);
+	}
+
+	thread_local nori::vm::Pool<nori::vm::VM<T>> pool{255};
+
+	auto vm = pool.acquire();
+	vm->reset(program, output, input);
+	return exec(*vm, options);
+}
+
+// Whether the run's result only depends on the program, the input and the limits
+bool
+memoizable(std::string_view program, RunOptions const &options) {
+	return options.memo && !options.profiler && !options.sampler && !options.stats && !options.tracer &&
+	       !options.record && options.restore.empty() && nori::vm::is_deterministic(program);
+}
+
+} // namespace
+
+int
+run_stream(std::istream &program, std::ostream &output, std::istream &input, RunOptions const &options) {
+	if (auto const error = run(program, output, input, options)) {
+		std::cerr << error->message << std::endl;
+		return error->status;
+	}
+	return 0;
+}
+
+RunResult
+run_memory(std::string_view program, std::string_view input, RunOptions const &options) {
+	std::ostringstream output{};
+	auto result = run_memory(program, input, output, options);
+	result.output = std::move(output).str();
+	return result;
+}
+
+RunResult
+run_memory(std::string_view program, std::string_view input, std::ostream &output, RunOptions const &options) {
+	if (memoizable(program, options)) {
+		auto result = options.memo->load(program, input, options.limits);
+		if (!result) {
+			RunOptions run_options = options;
+			run_options.memo = nullptr;
+			result = run_memory(program, input, run_options);
+			options.memo->store(program, input, options.limits, *result);
+		}
+		output << result->output;
+		return RunResult{.status = result->status, .error = std::move(result->error)};
+	}
+
+	nori::MemoryStream program_stream{program};
+	nori::MemoryStream input_stream{input};
+
+	auto error = run(program_stream, output, input_stream, options);
+
+	return RunResult{.status = error ? error->status : 0, .error = error ? std::move(error->message) : ""};
+}
+
+std::vector<RunResult>
+run_batch(std::vector<BatchJob> const &jobs, RunOptions const &options, std::size_t threads) {
+	std::vector<RunResult> results(jobs.size());
+	nori::ThreadPool pool{threads};
+
+	for (std::size_t i = 0; i < jobs.size(); ++i) {
+		pool.submit([&, i] {
+			RunOptions job_options = options;
+			job_options.stream = options.stream + i;
+			results[i] = run_memory(jobs[i].program, jobs[i].input, job_options);
+		});
+	}
+	pool.wait();
+
+	return results;
+}
+
+namespace {
+
+// What a Session and a Repl share: a VM taking fed input, and how its last run went
+struct FedRun {
+	std::ostringstream output{};
+	// Limits without any set cost a comparison per push, the sessions aren't worth a second VM type for that
+	nori::vm::VM<nori::MemoryStream, nori::vm::Rng, nori::vm::Limiter<>> vm{255};
+	Session::State state = Session::State::NeedsInput;
+	std::optional<Failure> failure{};
+
+	template <class F>
+	Session::State step(F &&run) {
+		if (state != Session::State::NeedsInput)
+			return state;
+		nori::vm::ExecStatus status{};
+		failure = check_failure(vm, [&] { return status = run(); });
+		if (failure)
+			state = Session::State::Failed;
+		else if (status == nori::vm::ExecStatus::Finished)
+			state = Session::State::Finished;
+		return state;
 	}
+
+	std::string take_output() {
+		auto taken = std::move(output).str();
+		output.str({});
+		return taken;
+	}
+};
+
+} // namespace
+
+struct Session::Impl : FedRun {
+	std::string bytecode;
+	nori::MemoryStream program{bytecode};
+
+	Impl(std::string &&code, RunOptions const &options) : bytecode{std::move(code)} {
+		vm.observer() = nori::vm::Limiter<>{options.limits};
+		vm.reset(program, output);
+		if (options.seed)
+			vm.seed(*options.seed, options.stream);
+	}
+};
+
+Session::Session(std::string bytecode, RunOptions const &options)
+    : _impl{std::make_unique<Impl>(std::move(bytecode), options)} {
+	_impl->step([&] { return _impl->vm.exec(); });
+}
+
+Session::Session(std::unique_ptr<Impl> impl) : _impl{std::move(impl)} {}
+
+Session
+Session::restore(std::string bytecode, std::string_view snapshot, RunOptions const &options) {
+	auto impl = std::make_unique<Impl>(std::move(bytecode), options);
+	impl->vm.restore(snapshot);
+	impl->step([&] { return impl->vm.resume(); });
+	return Session{std::move(impl)};
+}
+
+Session::Session(Session &&) noexcept = default;
+Session &Session::operator=(Session &&) noexcept = default;
+Session::~Session() = default;
+
+Session::State
+Session::feed(std::string_view input) {
+	_impl->vm.feed_input(input);
+	return _impl->step([&] { return _impl->vm.resume(); });
+}
+
+Session::State
+Session::close() {
+	_impl->vm.close_input();
+	return _impl->step([&] { return _impl->vm.resume(); });
+}
+
+Session::State
+Session::state() const {
+	return _impl->state;
+}
+
+std::string
+Session::snapshot() {
+	if (_impl->state != State::NeedsInput)
+		throw std::runtime_error{"Only a session waiting for input can be saved"};
+	std::string out{};
+	_impl->vm.snapshot(out);
+	return out;
+}
+
+std::string
+Session::take_output() {
+	return _impl->take_output();
+}
+
+int
+Session::status() const {
+	return _impl->failure ? _impl->failure->status : 0;
+}
+
+std::string_view
+Session::error() const {
+	return _impl->failure ? std::string_view{_impl->failure->message} : std::string_view{};
+}
+
+struct Repl::Impl : FedRun {
+	RunOptions options;
+	nori::IncrementalCompiler compiler{};
+	// The piece running now, the VM reads it from here
+	std::string bytecode{};
+	std::optional<nori::MemoryStream> program{};
+
+	Impl(RunOptions const &options) : options{options} { state = State::Finished; }
+};
+
+Repl::Repl(RunOptions const &options) : _impl{std::make_unique<Impl>(options)} {}
+Repl::Repl(Repl &&) noexcept = default;
+Repl &Repl::operator=(Repl &&) noexcept = default;
+Repl::~Repl() = default;
+
+Repl::State
+Repl::run(std::string_view source) {
+	auto &impl = *_impl;
+	if (impl.state == State::NeedsInput)
+		throw std::runtime_error{"The last piece is still waiting for input"};
+	auto const code = impl.compiler.compile(source);
+
+	bool const first = !impl.program;
+	impl.bytecode.assign(code.begin(), code.end());
+	impl.program.emplace(impl.bytecode);
+	if (first) {
+		impl.vm.reset(*impl.program, impl.output);
+		if (impl.options.seed)
+			impl.vm.seed(*impl.options.seed, impl.options.stream);
+	} else {
+		impl.vm.continue_with(*impl.program);
+	}
+	impl.vm.observer().renew(impl.options.limits);
+
+	impl.state = State::NeedsInput;
+	return impl.step([&] { return impl.vm.exec(); });
+}
+
+Repl::State
+Repl::feed(std::string_view input) {
+	_impl->vm.feed_input(input);
+	return _impl->step([&] { return _impl->vm.resume(); });
+}
+
+Repl::State
+Repl::close() {
+	_impl->vm.close_input();
+	return _impl->step([&] { return _impl->vm.resume(); });
+}
+
+Repl::State
+Repl::state() const {
+	return _impl->state;
+}
+
+std::string
+Repl::take_output() {
+	return _impl->take_output();
+}
+
+int
+Repl::status() const {
+	return _impl->failure ? _impl->failure->status : 0;
+}
+
+std::string_view
+Repl::error() const {
+	return _impl->failure ? std::string_view{_impl->failure->message} : std::string_view{};
+}
+
+std::vector<std::string_view> const &
+Repl::variables() const {
+	return _impl->compiler.variables();
 }
 
 void
@@ -28,8 +389,13 @@ compile(std::string_view const &source, std::ostream &out) {
 
 	auto iter = std::begin(toks);
 	auto const end = std::end(toks);
-	auto const nodes = nori::parse::parse(iter, end);
+	auto const ast = nori::parse::parse(iter, end);
 
-	auto const buffer = nori::compile(nodes);
+	auto const buffer = nori::compile(ast);
 	out.write(buffer.data(), buffer.size());
+}
+
+void
+compile_stream(std::istream &source, std::ostream &out) {
+	nori::compile_stream(source, out);
 }
\ No newline at end of file
@@ -2,14 +2,183 @@
 #ifndef NORI_HPP
 #define NORI_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "parse/parse.hpp"
+#include "vm/limits.hpp"
+#include "vm/stats.hpp"
+
+namespace nori::vm {
+class Profiler;
+class Sampler;
+class Tracer;
+struct Recording;
+} // namespace nori::vm
+
+namespace nori {
+class ResultCache;
+} // namespace nori
+
+struct RunStats {
+	nori::vm::Stats vm;
+	// Wall time of the run
+	double seconds = 0;
+};
+
+struct RunOptions {
+	// Seed for r, b and B. Seeded from std::random_device when empty.
+	std::optional<std::uint64_t> seed;
+	// Picks an independent random sequence for the same seed, e.g. one per parallel run
+	std::uint64_t stream = 0;
+	// Hooks for looking into a run. Only the first one set is used, and without any the run costs nothing extra.
+	// Collects an execution profile, adding to the counts already there
+	nori::vm::Profiler *profiler = nullptr;
+	// Samples the running position with a SIGPROF timer, only one run in the process can be sampled at a time
+	nori::vm::Sampler *sampler = nullptr;
+	// Filled in with what the run used
+	RunStats *stats = nullptr;
+	// Records an execution trace, finished once the run ends
+	nori::vm::Tracer *tracer = nullptr;
+	// Filled in with the seed and the input the run used, so it can be replayed. Works alongside any of the hooks
+	// above. Without a seed one is picked here, the same way the VM would.
+	nori::vm::Recording *record = nullptr;
+	// Stops the run with limit_exceeded_status once it goes over any of these. Also works alongside the hooks.
+	nori::vm::Limits limits{};
+	// Snapshot to carry on from instead of starting at the beginning, see Session::snapshot(). Its generator state
+	// replaces the seed.
+	std::string_view restore{};
+	// Results to reuse for run_memory(). Only runs of programs without r, b or B and without any of the options above
+	// besides limits go through it, anything else runs as normal.
+	nori::ResultCache *memo = nullptr;
+};
+
+// Status of a run stopped by RunOptions::limits, where other failures are 1
+inline constexpr int limit_exceeded_status = 2;
+
+struct RunResult {
+	// What run_stream would have returned
+	int status;
+	std::string output;
+	// What run_stream would have printed to stderr
+	std::string error;
+};
+
+struct BatchJob {
+	std::string_view program;
+	std::string_view input;
+};
 
 int
-run_stream(std::istream &program, std::ostream &out = std::cout, std::istream& in = std::cin);
+run_stream(
+    std::istream &program, std::ostream &out = std::cout, std::istream &in = std::cin, RunOptions const &options = {});
+
+// Runs bytecode that's already in memory, capturing the output
+RunResult
+run_memory(std::string_view program, std::string_view input = "", RunOptions const &options = {});
+
+// The same, writing the output to `output` as it goes instead of into the result
+RunResult
+run_memory(std::string_view program, std::string_view input, std::ostream &output, RunOptions const &options = {});
+
+// Runs every job on a thread pool with `threads` threads (one per hardware thread if zero). Results are in job order.
+// Job i uses random stream `options.stream + i`, so a seeded batch gives the same results however it's scheduled.
+std::vector<RunResult>
+run_batch(std::vector<BatchJob> const &jobs, RunOptions const &options = {}, std::size_t threads = 0);
+
+// A run that stops whenever it needs more input than it's been given instead of blocking, so one thread can drive any
+// number of them. Input ops that run out wait for feed() or close(), with everything else kept as it was.
+//
+// Honours the seed, stream and limits in RunOptions. The time limit counts time spent waiting for input too.
+class Session {
+  public:
+	enum class State {
+		NeedsInput,
+		Finished,
+		Failed,
+	};
+
+	// Runs straight away, up to the first input op that needs input or the end of the program
+	explicit Session(std::string bytecode, RunOptions const &options = {});
+	// Carries on from a snapshot() of a session running the same bytecode. Throws std::runtime_error if the snapshot
+	// is of something else.
+	static Session restore(std::string bytecode, std::string_view snapshot, RunOptions const &options = {});
+	Session(Session &&) noexcept;
+	Session &operator=(Session &&) noexcept;
+	~Session();
+
+	// Adds input and runs until the program finishes or runs out of input again
+	State feed(std::string_view input);
+	// Ends the input, so input ops fail as they would at the end of a stream, and runs on
+	State close();
+	State state() const;
+
+	// Output written since the last call
+	std::string take_output();
+	// What run_stream would return and print once it's failed, 0 and nothing until then
+	int status() const;
+	std::string_view error() const;
+
+	// Saves the session while it's waiting for input, for starting later sessions past a slow setup. Throws
+	// std::runtime_error in any other state.
+	std::string snapshot();
+
+  private:
+	struct Impl;
+	std::unique_ptr<Impl> _impl;
+
+	Session(std::unique_ptr<Impl> impl);
+};
+
+// Runs a program given a piece at a time, for nori repl. Each piece is compiled on its own and run on the same VM, so
+// it carries on with the stack, the variables, the generator and any input the pieces before it left. Input is fed
+// the same as in a Session.
+//
+// Honours the seed, stream and limits in RunOptions, the limits applying to each piece separately.
+class Repl {
+  public:
+	using State = Session::State;
+
+	explicit Repl(RunOptions const &options = {});
+	Repl(Repl &&) noexcept;
+	Repl &operator=(Repl &&) noexcept;
+	~Repl();
+
+	// Compiles `source` and runs it, up to the first input op that needs input or its end. Throws what compile() would
+	// if it doesn't compile, leaving everything as it was, and std::runtime_error if the last piece is still waiting
+	// for input. A piece that failed leaves the stack and variables the way they were when it stopped.
+	State run(std::string_view source);
+	// Adds input and runs the current piece until it finishes or runs out of input again
+	State feed(std::string_view input);
+	// Ends the input for good, so input ops fail as they would at the end of a stream, and runs on
+	State close();
+	State state() const;
+
+	// Output written since the last call
+	std::string take_output();
+	// The current piece's status and error, as for a Session
+	int status() const;
+	std::string_view error() const;
+
+	// Names of the variables the pieces so far have used
+	std::vector<std::string_view> const &variables() const;
+
+  private:
+	struct Impl;
+	std::unique_ptr<Impl> _impl;
+};
 
 void
 compile(std::string_view const &source, std::ostream &out);
 
+// Compiles from a stream a chunk at a time, for sources too big to keep in memory. `out` has to be seekable.
+void
+compile_stream(std::istream &source, std::ostream &out);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "cache.hpp"
+#include "compile.hpp"
+#include "hash.hpp"
+
+namespace nori {
+
+namespace {
+
+constexpr std::string_view magic = "NORC";
+
+// Hits then misses as two native endian 64 bit counts, rewritten in place
+constexpr char const *stats_file = "stats";
+
+// Second, independent hash stored inside the entry, so a collision on the file name can't hand back the wrong program
+constexpr std::uint64_t check_basis = 0x84222325cbf29ce4;
+
+std::uint64_t
+key(std::string_view source, std::uint64_t basis = Hasher::default_basis) {
+	return Hasher{basis}.field(compiler_version).field(source).digest();
+}
+
+std::filesystem::path
+entry_path(std::filesystem::path const &directory, std::string_view source) {
+	return directory / fmt::format("{:016x}.nr", key(source));
+}
+
+std::array<char, 8>
+check_bytes(std::string_view source) {
+	return std::bit_cast<std::array<char, 8>>(key(source, check_basis));
+}
+
+// Whether `name` is `<16 hex digits><extension>`, or a temporary file for one
+bool
+is_entry(std::string const &name, std::string_view extension) {
+	std::string_view const view{name};
+	auto const hex = view.substr(0, 16);
+	auto const is_hex = [](unsigned char c) { return std::isxdigit(c) != 0; };
+	if (hex.size() != 16 || !std::all_of(hex.begin(), hex.end(), is_hex))
+		return false;
+	auto const rest = view.substr(16);
+	return rest == extension || (rest.starts_with(fmt::format("{}.", extension)) && rest.ends_with(".tmp"));
+}
+
+// Removes the files in `directory` that is_entry() recognises
+void
+remove_entries(std::filesystem::path const &directory, std::string_view extension) {
+	std::error_code ec;
+	std::filesystem::directory_iterator it{directory, ec};
+	for (; !ec && it != std::filesystem::directory_iterator{}; it.increment(ec)) {
+		std::error_code ignored;
+		if (it->is_regular_file(ignored) && is_entry(it->path().filename().string(), extension))
+			std::filesystem::remove(it->path(), ignored);
+	}
+}
+
+std::array<std::uint64_t, 2>
+read_stats(int fd) {
+	std::array<std::uint64_t, 2> counts{};
+	if (pread(fd, counts.data(), sizeof(counts), 0) != sizeof(counts))
+		counts = {};
+	return counts;
+}
+
+} // namespace
+
+std::filesystem::path
+CompileCache::default_directory() {
+	if (auto const dir = std::getenv("NORI_CACHE_DIR"); dir && *dir)
+		return dir;
+	if (auto const dir = std::getenv("XDG_CACHE_HOME"); dir && *dir)
+		return std::filesystem::path{dir} / "nori";
+	if (auto const home = std::getenv("HOME"); home && *home)
+		return std::filesystem::path{home} / ".cache" / "nori";
+	return std::filesystem::temp_directory_path() / "nori";
+}
+
+CompileCache::CompileCache(std::filesystem::path directory) : _directory{std::move(directory)} {}
+
+CompileCache::~CompileCache() {
+	save_stats();
+}
+
+std::optional<std::string>
+CompileCache::load(std::string_view source) {
+	std::ifstream fs{entry_path(_directory, source), std::ios_base::binary};
+	std::string contents{std::istreambuf_iterator<char>{fs}, std::istreambuf_iterator<char>{}};
+
+	auto const check = check_bytes(source);
+	std::string_view const header{contents.data(), std::min(contents.size(), magic.size() + check.size())};
+	if (!fs || header.size() != magic.size() + check.size() || !header.starts_with(magic) ||
+	    !std::equal(check.begin(), check.end(), header.begin() + magic.size())) {
+		_misses.fetch_add(1, std::memory_order_relaxed);
+		return std::nullopt;
+	}
+
+	_hits.fetch_add(1, std::memory_order_relaxed);
+	contents.erase(0, header.size());
+	return contents;
+}
+
+void
+CompileCache::store(std::string_view source, std::string_view bytecode) {
+	std::error_code ec;
+	std::filesystem::create_directories(_directory, ec);
+	if (ec)
+		return;
+
+	auto const path = entry_path(_directory, source);
+	auto tmp = path;
+	tmp += fmt::format(".{}.{:x}.tmp", getpid(), std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+	{
+		std::ofstream fs{tmp, std::ios_base::binary | std::ios_base::trunc};
+		auto const check = check_bytes(source);
+		fs.write(magic.data(), magic.size());
+		fs.write(check.data(), check.size());
+		fs.write(bytecode.data(), bytecode.size());
+		if (!fs) {
+			fs.close();
+			std::filesystem::remove(tmp, ec);
+			return;
+		}
+	}
+
+	std::filesystem::rename(tmp, path, ec);
+	if (ec)
+		std::filesystem::remove(tmp, ec);
+}
+
+CompileCache::Stats
+CompileCache::stats() const {
+	Stats stats{.hits = _hits.load(), .misses = _misses.load()};
+	auto const fd = open((_directory / stats_file).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return stats;
+	flock(fd, LOCK_SH);
+	auto const [hits, misses] = read_stats(fd);
+	close(fd);
+	return Stats{.hits = stats.hits + hits, .misses = stats.misses + misses};
+}
+
+void
+CompileCache::clear() {
+	remove_entries(_directory, ".nr");
+	remove_entries(_directory / "results", ".res");
+	std::error_code ec;
+	// Only goes if it's empty now
+	std::filesystem::remove(_directory / "results", ec);
+	std::filesystem::remove(_directory / stats_file, ec);
+	_hits = 0;
+	_misses = 0;
+}
+
+// Other processes sharing the directory save theirs too, the lock keeps the read-modify-write from losing counts
+void
+CompileCache::save_stats() {
+	std::array<std::uint64_t, 2> const counts{_hits.exchange(0), _misses.exchange(0)};
+	if (counts[0] == 0 && counts[1] == 0)
+		return;
+
+	std::error_code ec;
+	std::filesystem::create_directories(_directory, ec);
+	auto const fd = open((_directory / stats_file).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return;
+	flock(fd, LOCK_EX);
+	auto totals = read_stats(fd);
+	totals[0] += counts[0];
+	totals[1] += counts[1];
+	[[maybe_unused]] auto const written = pwrite(fd, totals.data(), sizeof(totals), 0);
+	close(fd);
+}
+
+} // namespace nori
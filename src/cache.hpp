@@ -0,0 +1,56 @@
+#pragma once
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace nori {
+
+// On disk cache of compiled bytecode, keyed by a hash of the source text and the compiler version.
+//
+// Entries are written to a temporary file and renamed into place, so any number of processes can share a cache
+// directory. Failing to read or write the cache is never an error, it only means compiling again.
+//
+// Hits and misses are counted in memory and added to the totals on disk once, when the cache is destroyed.
+class CompileCache {
+  public:
+	struct Stats {
+		std::uint64_t hits;
+		std::uint64_t misses;
+	};
+
+	// $NORI_CACHE_DIR, falling back to $XDG_CACHE_HOME/nori and then ~/.cache/nori
+	static std::filesystem::path default_directory();
+
+	CompileCache(std::filesystem::path directory = default_directory());
+	CompileCache(CompileCache const &) = delete;
+	CompileCache &operator=(CompileCache const &) = delete;
+	~CompileCache();
+
+	std::optional<std::string> load(std::string_view source);
+	void store(std::string_view source, std::string_view bytecode);
+
+	// The totals on disk plus what this cache hasn't saved yet
+	Stats stats() const;
+	// Removes the entries, the memoized results and the counters. Anything else in the directory is left alone, it
+	// could be somewhere the user keeps other files.
+	void clear();
+
+	std::filesystem::path const &directory() const { return _directory; }
+
+  private:
+	std::filesystem::path _directory;
+	std::atomic<std::uint64_t> _hits{0};
+	std::atomic<std::uint64_t> _misses{0};
+
+	void save_stats();
+};
+
+} // namespace nori
+
+#endif
@@ -2,19 +2,22 @@
 #include <bit>
 #include <limits>
 #include <stdexcept>
+#include <string>
 #include <string_view>
 #include <type_traits>
 #include <unordered_map>
 #include <variant>
 
 #include "compile.hpp"
+#include "parse/parse.hpp"
+#include "parse/stream_tokens.hpp"
+#include "parse/tokens.hpp"
+#include "slots.hpp"
 #include "utils.hpp"
 #include "vm/op.hpp"
 
 namespace nori {
 
-using IdentifierMap = std::unordered_map<std::string, std::uint8_t>;
-
 void
 insert_double(std::vector<char> &buffer, double x) {
 	auto const arr = std::bit_cast<std::array<char, 8>>(x);
@@ -22,100 +25,297 @@ insert_double(std::vector<char> &buffer, double x) {
 }
 
 void
-insert_string(std::vector<char> &buffer, std::string const &value) {
+insert_string(std::vector<char> &buffer, std::string_view value) {
 	buffer.insert(buffer.end(), value.begin(), value.end());
 	buffer.emplace_back(0);
 }
 
-std::uint8_t
-get_or_new_id(IdentifierMap &vars, std::string const &name) {
-	auto const res = vars.find(name);
-	if (res != vars.end()) {
-		return res->second;
+void
+compile_push(std::vector<char> &result, parse::Ast const &ast, parse::Node const &node) {
+	if (node.type == parse::NodeType::PushNode || node.type == parse::NodeType::SetVarNumber) {
+		result.emplace_back(vm::Op::Push);
+		insert_double(result, node.number);
 	} else {
-		const std::size_t index = vars.size();
-		if (index > std::numeric_limits<std::uint8_t>::max()) {
-			throw std::runtime_error{"Limit on number of variables reached"};
-		}
-		vars.insert(std::pair{name, index});
-		return index;
+		result.emplace_back(vm::Op::PushString);
+		insert_string(result, ast.strings[node.string]);
 	}
 }
 
+// Compiles the nodes in [begin, end)
 void
-compile(std::vector<char> &result, parse::PushNode const &node, IdentifierMap &) {
-	std::visit(
-	    overloaded{
-	        [&](double const &value) {
-		        result.emplace_back(vm::Op::Push);
-		        insert_double(result, value);
-	        },
-	        [&](std::string const &value) {
-		        result.emplace_back(vm::Op::PushString);
-		        insert_string(result, value);
-	        }},
-	    node.value);
-}
+compile_body(
+    std::vector<char> &result, parse::Ast const &ast, SlotAllocation const &slots, std::size_t begin, std::size_t end) {
+	for (std::size_t i = begin; i < end;) {
+		auto const &node = ast.nodes[i];
 
-void
-compile(std::vector<char> &result, parse::PushVar const &node, IdentifierMap &vars) {
-	result.emplace_back(vm::Op::PushVar);
-	result.emplace_back(get_or_new_id(vars, node.name));
-}
+		switch (node.type) {
+		case parse::NodeType::PushNode:
+		case parse::NodeType::PushString:
+			compile_push(result, ast, node);
+			++i;
+			break;
 
-void
-compile(std::vector<char> &result, parse::SetVarPop const &node, IdentifierMap &vars) {
-	result.emplace_back(vm::Op::SetVarPop);
-	result.emplace_back(get_or_new_id(vars, node.name));
-}
+		case parse::NodeType::PushVar:
+			result.emplace_back(vm::Op::PushVar);
+			result.emplace_back(slots.slots[node.arg]);
+			++i;
+			break;
 
-void
-compile(std::vector<char> &result, parse::SetVarValue const &node, IdentifierMap &vars) {
-	// ? Note: not very efficient, but it means the vm doesn't need more instructions
-	compile(result, parse::PushNode{node.value}, vars);
-	compile(result, parse::SetVarPop{node.name}, vars);
-}
+		case parse::NodeType::SetVarPop:
+			// A dead store still takes the value off the stack
+			if (slots.is_dead(i)) {
+				result.emplace_back(vm::Op::Pop);
+			} else {
+				result.emplace_back(vm::Op::SetVarPop);
+				result.emplace_back(slots.slots[node.arg]);
+			}
+			++i;
+			break;
 
-#define X(NodeName, OpName) \
-	void compile(std::vector<char> &result, parse::NodeName const &node, IdentifierMap &) { \
-		result.emplace_back(vm::Op::OpName); \
-	}
+		case parse::NodeType::SetVarNumber:
+		case parse::NodeType::SetVarString:
+			if (!slots.is_dead(i)) {
+				// ? Note: not very efficient, but it means the vm doesn't need more instructions
+				compile_push(result, ast, node);
+				result.emplace_back(vm::Op::SetVarPop);
+				result.emplace_back(slots.slots[node.arg]);
+			}
+			++i;
+			break;
+
+		case parse::NodeType::ConditionalNode: {
+			std::vector<char> inner{};
+			compile_body(inner, ast, slots, i + 1, node.arg);
+
+			result.emplace_back(vm::Op::ForwardJumpFalse);
+			result.emplace_back(inner.size() + 2);
+			result.insert(result.end(), inner.begin(), inner.end());
+			result.emplace_back(vm::Op::BackwardJumpTrue);
+			result.emplace_back(inner.size() + 2);
+			i = node.arg;
+			break;
+		}
 
-XNODES_TO_OP
+		case parse::NodeType::MapNode:
+			result.emplace_back(vm::Op::Map);
+			switch (static_cast<parse::NodeType>(node.arg)) {
+#define X(Name) \
+	case parse::NodeType::Name##Node: result.emplace_back(vm::Op::Name); break;
 
+				XMAPOPS
 #undef X
+			default: throw std::runtime_error{"A can't apply that op"};
+			}
+			++i;
+			break;
 
-void compile_body(std::vector<char> &result, std::vector<parse::Node> const &nodes, IdentifierMap &vars);
+#define X(NodeName, OpName) \
+	case parse::NodeType::NodeName: \
+		result.emplace_back(vm::Op::OpName); \
+		++i; \
+		break;
 
-void
-compile(std::vector<char> &result, parse::ConditionalNode const &node, IdentifierMap &vars) {
-	std::vector<char> inner{};
-	compile_body(inner, node.body, vars);
-
-	result.emplace_back(vm::Op::ForwardJumpFalse);
-	result.emplace_back(inner.size() + 2);
-	result.insert(result.end(), inner.begin(), inner.end());
-	result.emplace_back(vm::Op::BackwardJumpTrue);
-	result.emplace_back(inner.size() + 2);
-}
+			XNODES_TO_OP
 
-void
-compile_body(std::vector<char> &result, std::vector<parse::Node> const &nodes, IdentifierMap &vars) {
-	for (auto const &node : nodes) {
-		std::visit([&](auto &&x) { compile(result, x, vars); }, node);
+#undef X
+		}
 	}
 }
 
 std::vector<char>
-compile(std::vector<parse::Node> const &nodes) {
-	IdentifierMap vars{};
+compile(parse::Ast const &ast, bool allocate) {
+	if (ast.identifiers.size() > std::numeric_limits<std::uint8_t>::max() + 1) {
+		throw std::runtime_error{"Limit on number of variables reached"};
+	}
+
+	auto const slots = allocate ? allocate_slots(ast) : identity_slots(ast);
 	std::vector<char> result{};
-	result.emplace_back(0);
-	compile_body(result, nodes, vars);
-	result.front() = vars.size();
+	result.emplace_back(slots.count);
+	compile_body(result, ast, slots, 0, ast.nodes.size());
 	result.emplace_back(vm::Op::Return);
 
 	return result;
 }
 
-} // namespace nori
\ No newline at end of file
+std::vector<char>
+IncrementalCompiler::compile(std::string_view source) {
+	parse::Tokens toks{source};
+	auto iter = std::begin(toks);
+	auto const ast = parse::parse(iter, std::end(toks), _variables);
+	// Later pieces can read anything, so nothing is dead and slots stay put
+	auto bytecode = nori::compile(ast, false);
+
+	for (auto i = _variables.size(); i < ast.identifiers.size(); ++i)
+		_variables.emplace_back(_names.emplace_back(ast.identifiers[i]));
+	return bytecode;
+}
+
+namespace {
+
+// Compiles straight from a token stream to bytecode, producing the same bytecode as parse() followed by compile()
+// without slot allocation, which needs the whole AST.
+//
+// No AST is built, and loop bodies are emitted in place with their jump distances patched in once the closing ] is
+// reached. What's kept in memory is the current token, the identifier names and one output offset per open loop.
+class StreamCompiler {
+  public:
+	StreamCompiler(std::istream &source, std::ostream &out) : _tokens{source}, _out{out}, _more{false} {}
+
+	void compile() {
+		auto const start = _out.tellp();
+		_out.put(0);
+
+		advance();
+		body();
+		_out.put(vm::Op::Return);
+
+		// The variable count in the header is only known now
+		auto const end = _out.tellp();
+		_out.seekp(start);
+		_out.put(static_cast<char>(_vars.size()));
+		_out.seekp(end);
+	}
+
+  private:
+	parse::StreamTokens _tokens;
+	std::ostream &_out;
+	// Names have to be copied, the token's view dies with the next token
+	std::unordered_map<std::string, std::uint8_t> _vars;
+	bool _more;
+
+	void advance() { _more = _tokens.next(); }
+	parse::Token const &tok() const { return _tokens.current(); }
+
+	std::uint8_t slot(std::string_view name) {
+		auto const [it, inserted] = _vars.try_emplace(std::string{name}, _vars.size());
+		if (inserted && _vars.size() > std::numeric_limits<std::uint8_t>::max() + 1)
+			throw std::runtime_error{"Limit on number of variables reached"};
+		return it->second;
+	}
+
+	void push_value(parse::TokenValue const &value) {
+		std::visit(
+		    overloaded{
+		        [&](double const &number) {
+			        auto const arr = std::bit_cast<std::array<char, 8>>(number);
+			        _out.put(vm::Op::Push);
+			        _out.write(arr.data(), arr.size());
+		        },
+		        [&](std::string_view const &str) {
+			        _out.put(vm::Op::PushString);
+			        _out.write(str.data(), str.size());
+			        _out.put(0);
+		        }},
+		    value);
+	}
+
+	void set_var(std::uint8_t id) {
+		_out.put(vm::Op::SetVarPop);
+		_out.put(static_cast<char>(id));
+	}
+
+	void body() {
+		while (_more) {
+			switch (tok().type) {
+			case parse::TokenType::Push:
+				advance();
+				if (!_more)
+					throw std::runtime_error{"Unexpected end of input"};
+				if (tok().type == parse::TokenType::Value) {
+					push_value(tok().value);
+				} else if (tok().type == parse::TokenType::Identifier) {
+					_out.put(vm::Op::PushVar);
+					_out.put(static_cast<char>(slot(std::get<std::string_view>(tok().value))));
+				} else {
+					throw parse::UnexpectedTokenError({parse::TokenType::Value}, tok());
+				}
+				advance();
+				break;
+
+			case parse::TokenType::Identifier: {
+				auto const id = slot(std::get<std::string_view>(tok().value));
+				advance();
+				if (!_more)
+					throw parse::UnexpectedEndOfInput{{parse::TokenType::Pop, parse::TokenType::Value}};
+				if (tok().type == parse::TokenType::Value) {
+					push_value(tok().value);
+				} else if (tok().type != parse::TokenType::Pop) {
+					throw parse::UnexpectedTokenError{{parse::TokenType::Pop, parse::TokenType::Value}, tok()};
+				}
+				set_var(id);
+				advance();
+				break;
+			}
+
+			case parse::TokenType::LBracket: {
+				advance();
+				auto const start = _out.tellp();
+				_out.put(vm::Op::ForwardJumpFalse);
+				_out.put(0);
+				body();
+				if (!_more) {
+					throw parse::UnexpectedEndOfInput{{parse::TokenType::RBracket}};
+				} else if (tok().type != parse::TokenType::RBracket) {
+					throw parse::UnexpectedTokenError{{parse::TokenType::RBracket}, tok()};
+				}
+				advance();
+
+				auto const distance = static_cast<char>(_out.tellp() - start);
+				_out.put(vm::Op::BackwardJumpTrue);
+				_out.put(distance);
+				auto const end = _out.tellp();
+				_out.seekp(start + std::streamoff{1});
+				_out.put(distance);
+				_out.seekp(end);
+				break;
+			}
+
+			case parse::TokenType::RBracket: return;
+
+			case parse::TokenType::Map:
+				advance();
+#define X(Name) parse::TokenType::Name,
+				if (!_more)
+					throw parse::UnexpectedEndOfInput{{XMAPOPS}};
+				switch (tok().type) {
+#undef X
+#define X(Name) \
+	case parse::TokenType::Name: \
+		_out.put(vm::Op::Map); \
+		_out.put(vm::Op::Name); \
+		break;
+
+					XMAPOPS
+#undef X
+#define X(Name) parse::TokenType::Name,
+				default: throw parse::UnexpectedTokenError{{XMAPOPS}, tok()};
+#undef X
+				}
+				advance();
+				break;
+
+#define X(TokenName, NodeName) \
+	case parse::TokenType::TokenName: \
+		_out.put(vm::Op::TokenName); \
+		advance(); \
+		break;
+
+				XNODES
+#undef X
+			default:
+#define X(TokenName, _) parse::TokenType::TokenName,
+				throw parse::UnexpectedTokenError{{parse::TokenType::Push, XNODES parse::TokenType::Map}, tok()};
+#undef X
+			}
+		}
+	}
+};
+
+} // namespace
+
+void
+compile_stream(std::istream &source, std::ostream &out) {
+	StreamCompiler{source, out}.compile();
+}
+
+} // namespace nori
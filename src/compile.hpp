@@ -2,14 +2,46 @@
 #ifndef COMPILE_HPP
 #define COMPILE_HPP
 
+#include <deque>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "parse/node.hpp"
 
 namespace nori {
 
+// Bump whenever the bytecode produced for the same source changes, cached bytecode is keyed on it
+inline constexpr std::string_view compiler_version = "3";
+
+// With `allocate`, stores that are never read are dropped and variables share slots where they can, see
+// allocate_slots(). Otherwise identifiers are given variable slots by id.
 std::vector<char>
-compile(std::vector<nori::parse::Node> const &nodes);
+compile(parse::Ast const &ast, bool allocate = true);
+
+// Compiles a program a piece at a time, for running the pieces one after another on the same VM (see nori repl).
+// Variables keep the slots earlier pieces gave them, so each piece sees what the ones before it stored.
+class IncrementalCompiler {
+  public:
+	// Bytecode for `source` alone, header and Return included. Throws the same as compile(), in which case the piece
+	// is forgotten and its new variables don't take up slots.
+	std::vector<char> compile(std::string_view source);
+
+	// Names of the variables so far, by slot
+	std::vector<std::string_view> const &variables() const { return _variables; }
+
+  private:
+	// Names outlive the source they came from, a deque doesn't move them as it grows
+	std::deque<std::string> _names;
+	std::vector<std::string_view> _variables;
+};
+
+// Compiles without holding the source or an AST in memory, so without slot allocation. `out` has to be seekable, jump
+// distances and the header are patched in after the fact.
+void
+compile_stream(std::istream &source, std::ostream &out);
 
 } // namespace nori
 
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstdint>
+#include <string_view>
+
+namespace nori {
+
+// Incremental 64 bit FNV-1a. Not cryptographic, only meant for cache keys.
+class Hasher {
+  public:
+	static constexpr std::uint64_t default_basis = 0xcbf29ce484222325;
+
+	constexpr Hasher(std::uint64_t basis = default_basis) : _state{basis} {}
+
+	constexpr Hasher &update(std::string_view data) {
+		for (unsigned char const c : data) {
+			_state ^= c;
+			_state *= 0x100000001b3;
+		}
+		return *this;
+	}
+
+	// Mixes in the length too, so consecutive fields can't run into each other
+	constexpr Hasher &field(std::string_view data) {
+		std::uint64_t size = data.size();
+		for (int i = 0; i < 8; ++i, size >>= 8) {
+			_state ^= size & 0xff;
+			_state *= 0x100000001b3;
+		}
+		return update(data);
+	}
+
+	constexpr std::uint64_t digest() const { return _state; }
+
+  private:
+	std::uint64_t _state;
+};
+
+} // namespace nori
+
+#endif
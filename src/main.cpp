@@ -1,102 +1,932 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <csignal>
+#include <chrono>
 #include <cstddef>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <istream>
 #include <iterator>
+#include <map>
+#include <optional>
+#include <span>
 #include <sstream>
 #include <stdexcept>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
 
 #include <fmt/ranges.h>
 
 #include "api.hpp"
+#include "cache.hpp"
+#include "memstream.hpp"
+#include "result_cache.hpp"
+#include "server.hpp"
+#include "thread_pool.hpp"
+#include "vm/profiler.hpp"
+#include "vm/recording.hpp"
+#include "vm/sampler.hpp"
+#include "vm/trace.hpp"
+
+struct RunArgs {
+	std::vector<char const *> files;
+	RunOptions options;
+	bool use_cache = true;
+	// Compile a chunk at a time instead of reading the whole source first
+	bool stream = false;
+	// Print an execution profile to stderr
+	bool profile = false;
+	// Where to write the profile as JSON, if anywhere
+	std::string_view profile_json{};
+	// Print what the run used to stderr
+	bool stats = false;
+	// Where to write sampled folded stacks, if anywhere
+	std::string_view sample{};
+	std::uint64_t sample_interval = 1000;
+	// Where to write an execution trace, if anywhere
+	std::string_view trace{};
+	// Where to save the run's input and seed, and where to take them from instead of stdin
+	std::string_view record{};
+	std::string_view replay{};
+	// Where to save the program once it first waits for input, and a snapshot to carry on from
+	std::string_view snapshot{};
+	std::string_view restore{};
+	// Socket of a `nori serve` to run on instead
+	std::string_view connect{};
+	// Reuse the results of earlier runs with the same program and input
+	bool memo = false;
+	// Every flag given, for commands to turn down the ones they don't take
+	std::vector<std::string_view> given{};
+};
+
+template <class N>
+bool
+parse_number(std::string_view flag, std::string_view value, N &out) {
+	auto const [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+	if (ec != std::errc{} || ptr != value.data() + value.size()) {
+		fmt::print(stderr, "Invalid value for {}: {}\n", flag, value);
+		return false;
+	}
+	return true;
+}
+
+// Splits the flags shared by run, build, exec and batch from the file arguments. `extra` holds command specific flags
+// that take a value, along with where to put it. Each command turns down the flags it doesn't take with check_flags().
+std::optional<RunArgs>
+parse_run_args(int argc, char const **argv, std::map<std::string_view, std::string_view *> const &extra = {}) {
+	RunArgs args{};
+	std::string_view seed{};
+	std::string_view interval{};
+	std::string_view fuel{};
+	std::string_view max_stack{};
+	std::string_view max_string_bytes{};
+	std::string_view timeout{};
+	auto flags = extra;
+	flags.emplace("--seed", &seed);
+	flags.emplace("--fuel", &fuel);
+	flags.emplace("--max-stack", &max_stack);
+	flags.emplace("--max-string-bytes", &max_string_bytes);
+	flags.emplace("--timeout", &timeout);
+	flags.emplace("--profile-json", &args.profile_json);
+	flags.emplace("--sample", &args.sample);
+	flags.emplace("--sample-interval", &interval);
+	flags.emplace("--trace", &args.trace);
+	flags.emplace("--record", &args.record);
+	flags.emplace("--replay", &args.replay);
+	flags.emplace("--snapshot", &args.snapshot);
+	flags.emplace("--restore", &args.restore);
+	flags.emplace("--connect", &args.connect);
+
+	for (int i = 1; i < argc; ++i) {
+		std::string_view const arg{argv[i]};
+		if (!arg.starts_with("--")) {
+			args.files.emplace_back(argv[i]);
+			continue;
+		}
+		args.given.push_back(arg);
+		if (arg == "--no-cache") {
+			args.use_cache = false;
+			continue;
+		}
+		if (arg == "--stream") {
+			args.stream = true;
+			continue;
+		}
+		if (arg == "--profile") {
+			args.profile = true;
+			continue;
+		}
+		if (arg == "--stats") {
+			args.stats = true;
+			continue;
+		}
+		if (arg == "--memo") {
+			args.memo = true;
+			continue;
+		}
+
+		auto const found = flags.find(arg);
+		if (found == flags.end()) {
+			fmt::print(stderr, "Unknown option {}\n", arg);
+			return std::nullopt;
+		}
+		if (++i == argc) {
+			fmt::print(stderr, "{} requires a value\n", arg);
+			return std::nullopt;
+		}
+		*found->second = argv[i];
+	}
+
+	if (!seed.empty()) {
+		args.options.seed.emplace();
+		if (!parse_number("--seed", seed, *args.options.seed))
+			return std::nullopt;
+	}
+	auto &limits = args.options.limits;
+	if (!fuel.empty() && !parse_number("--fuel", fuel, limits.fuel))
+		return std::nullopt;
+	if (!max_stack.empty() && !parse_number("--max-stack", max_stack, limits.stack))
+		return std::nullopt;
+	if (!max_string_bytes.empty() && !parse_number("--max-string-bytes", max_string_bytes, limits.string_bytes))
+		return std::nullopt;
+	if (!timeout.empty()) {
+		std::uint64_t ms;
+		if (!parse_number("--timeout", timeout, ms))
+			return std::nullopt;
+		limits.time = std::chrono::milliseconds{ms};
+	}
+	if (!interval.empty()) {
+		if (!parse_number("--sample-interval", interval, args.sample_interval))
+			return std::nullopt;
+		if (args.sample_interval == 0) {
+			fmt::print(stderr, "Invalid value for --sample-interval: 0\n");
+			return std::nullopt;
+		}
+	}
+	return args;
+}
+
+// Flags for the limits, taken by every command that runs programs
+constexpr std::array<std::string_view, 4> limit_flags{"--fuel", "--max-stack", "--max-string-bytes", "--timeout"};
+// Flags for running bytecode here, taken by run and exec
+constexpr std::array<std::string_view, 12> local_run_flags{
+    "--seed",  "--stats",  "--profile", "--profile-json", "--sample",  "--sample-interval",
+    "--trace", "--record", "--replay",  "--snapshot",     "--restore", "--memo"};
 
+// False, saying why, if `args` has a flag that isn't in one of `groups`
+bool
+check_flags(
+    RunArgs const &args, std::string_view command, std::initializer_list<std::span<std::string_view const>> groups) {
+	for (auto const flag : args.given) {
+		if (std::none_of(groups.begin(), groups.end(), [&](auto const group) {
+			    return std::find(group.begin(), group.end(), flag) != group.end();
+		    })) {
+			fmt::print(stderr, "{} doesn't take {}\n", command, flag);
+			return false;
+		}
+	}
+	return true;
+}
+
+std::optional<std::string>
+read_file(char const *filename) {
+	std::ifstream fs{filename, std::ios_base::binary};
+	if (!fs) {
+		fmt::print(stderr, "Couldn't open {}\n", filename);
+		return std::nullopt;
+	}
+	std::stringstream contents{};
+	contents << fs.rdbuf();
+	return std::move(contents).str();
+}
+
+// Runs bytecode, profiling, sampling or counting it if that was asked for. Reports go to stderr, apart from the
+// program's output.
 int
-run(int argc, char const **argv) {
-	if (argc < 2) {
-		fmt::print("File required\n");
+run_hooked(std::istream &program, std::istream &input, RunArgs const &args, RunOptions options) {
+	bool const profile = args.profile || !args.profile_json.empty();
+	if (profile + !args.sample.empty() + args.stats + !args.trace.empty() > 1) {
+		fmt::print(stderr, "Only one of --profile, --sample, --stats and --trace can be used at a time\n");
 		return 1;
 	}
 
-	auto filename = argv[1];
-	std::ifstream fs{filename};
-	return run_stream(fs);
+	if (!args.trace.empty()) {
+		std::ofstream fs{std::string{args.trace}, std::ios_base::binary | std::ios_base::trunc};
+		if (!fs) {
+			fmt::print(stderr, "Couldn't open {}\n", args.trace);
+			return 1;
+		}
+		nori::vm::Tracer tracer{fs};
+		options.tracer = &tracer;
+		return run_stream(program, std::cout, input, options);
+	}
+
+	if (args.stats) {
+		RunStats stats{};
+		options.stats = &stats;
+		auto const status = run_stream(program, std::cout, input, options);
+		std::cout.flush();
+
+		auto const &vm = stats.vm;
+		fmt::print(
+		    stderr,
+		    "\ninstructions:       {}\nwall time:          {:.6f}s\nvalues pushed:      {}\nstack peak:         {}\n"
+		    "string bytes peak:  {}\nstring allocations: {}\nvariables:          {}\nbytecode loads:     {}\n"
+		    "bytecode bytes:     {}\n",
+		    vm.instructions, stats.seconds, vm.values_pushed, vm.stack_peak, vm.string_bytes_peak,
+		    vm.string_allocations, vm.variables, vm.loads, vm.bytecode_bytes);
+		return status;
+	}
+
+	if (!args.sample.empty()) {
+		nori::vm::Sampler sampler{std::chrono::microseconds{args.sample_interval}};
+		options.sampler = &sampler;
+		auto const status = run_stream(program, std::cout, input, options);
+
+		program.clear();
+		program.seekg(0);
+		std::string const bytecode{std::istreambuf_iterator<char>{program}, std::istreambuf_iterator<char>{}};
+		std::ofstream fs{std::string{args.sample}, std::ios_base::trunc};
+		fs << sampler.folded(bytecode);
+		if (auto const dropped = sampler.dropped())
+			fmt::print(stderr, "{} samples dropped, the buffer was full\n", dropped);
+		return status;
+	}
+
+	if (!profile && args.memo) {
+		// The whole input is needed up front to look the result up
+		std::string const bytecode{std::istreambuf_iterator<char>{program}, std::istreambuf_iterator<char>{}};
+		std::string const contents{std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{}};
+		nori::ResultCache memo{nori::ResultCache::default_memory, nori::ResultCache::default_directory()};
+		options.memo = &memo;
+		auto const result = run_memory(bytecode, contents, std::cout, options);
+		if (result.status != 0)
+			fmt::print(stderr, "{}\n", result.error);
+		return result.status;
+	}
+
+	if (!profile)
+		return run_stream(program, std::cout, input, options);
+
+	nori::vm::Profiler profiler{};
+	options.profiler = &profiler;
+	auto const status = run_stream(program, std::cout, input, options);
+	std::cout.flush();
+
+	if (args.profile)
+		fmt::print(stderr, "\n{}", profiler.report());
+	if (!args.profile_json.empty()) {
+		std::ofstream fs{std::string{args.profile_json}, std::ios_base::trunc};
+		fs << profiler.json();
+	}
+	return status;
 }
 
+// Runs bytecode up to the first time it waits for input and saves it there
 int
-build(int argc, char const **argv) {
-	if (argc < 2) {
-		fmt::print("File required\n");
+save_snapshot(std::istream &program, RunArgs const &args) {
+	std::string bytecode{std::istreambuf_iterator<char>{program}, std::istreambuf_iterator<char>{}};
+	Session session{std::move(bytecode), args.options};
+	fmt::print("{}", session.take_output());
+	if (session.state() == Session::State::Failed) {
+		fmt::print(stderr, "{}\n", session.error());
+		return session.status();
+	}
+	if (session.state() == Session::State::Finished) {
+		fmt::print(stderr, "The program finished without waiting for input, there's nothing to snapshot\n");
 		return 1;
 	}
 
-	std::string filename{argv[1]};
-	std::ifstream fs{filename};
+	std::ofstream fs{std::string{args.snapshot}, std::ios_base::binary | std::ios_base::trunc};
+	if (!fs) {
+		fmt::print(stderr, "Couldn't open {}\n", args.snapshot);
+		return 1;
+	}
+	auto const snapshot = session.snapshot();
+	fs.write(snapshot.data(), snapshot.size());
+	return 0;
+}
+
+// Runs bytecode, recording its input and seed or replaying them if that was asked for
+int
+run_program(std::istream &program, RunArgs const &args) {
+	if (!args.snapshot.empty())
+		return save_snapshot(program, args);
 
-	std::size_t ext_index = filename.find_last_of('.');
-	if (ext_index == std::string::npos)
-		ext_index = filename.size();
+	auto options = args.options;
 
-	std::size_t const ext_len = filename.size() - ext_index;
-	filename.replace(ext_index, ext_len, ".nr");
+	std::optional<std::string> restore{};
+	if (!args.restore.empty()) {
+		restore = read_file(std::string{args.restore}.c_str());
+		if (!restore)
+			return 1;
+		options.restore = *restore;
+	}
+
+	std::optional<nori::vm::Recording> replay{};
+	std::optional<nori::MemoryStream> replay_input{};
+	if (!args.replay.empty()) {
+		if (options.seed) {
+			fmt::print(stderr, "--seed can't be used with --replay, the recording has its own\n");
+			return 1;
+		}
+		std::ifstream fs{std::string{args.replay}, std::ios_base::binary};
+		if (!fs) {
+			fmt::print(stderr, "Couldn't open {}\n", args.replay);
+			return 1;
+		}
+		try {
+			replay = nori::vm::Recording::read(fs);
+		} catch (std::runtime_error const &err) {
+			fmt::print(stderr, "{}: {}\n", args.replay, err.what());
+			return 1;
+		}
+		options.seed = replay->seed;
+		options.stream = replay->stream;
+		replay_input.emplace(replay->input);
+	}
+	std::istream &input = replay_input ? static_cast<std::istream &>(*replay_input) : std::cin;
 
-	std::stringstream sourcestream{};
-	sourcestream << fs.rdbuf();
-	std::string const source = sourcestream.str();
+	if (args.record.empty())
+		return run_hooked(program, input, args, options);
 
+	// Opened first so a bad path is reported before the run rather than after it
+	std::ofstream fs{std::string{args.record}, std::ios_base::binary | std::ios_base::trunc};
+	if (!fs) {
+		fmt::print(stderr, "Couldn't open {}\n", args.record);
+		return 1;
+	}
+	nori::vm::Recording recording{};
+	options.record = &recording;
+	auto const status = run_hooked(program, input, args, options);
+	recording.write(fs);
+	return status;
+}
+
+int
+run(int argc, char const **argv) {
+	auto const args = parse_run_args(argc, argv);
+	if (!args)
+		return 1;
+
+	if (args->files.empty()) {
+		fmt::print("File required\n");
+		return 1;
+	}
+
+	if (!args->connect.empty()) {
+		// Only the seed and the limits are passed on
+		constexpr std::array<std::string_view, 2> remote_flags{"--connect", "--seed"};
+		if (!check_flags(*args, "run --connect", {remote_flags, limit_flags}))
+			return 1;
+		return nori::run_remote(args->connect, args->files.front(), std::cout, std::cin, args->options);
+	}
+	if (!check_flags(*args, "run", {local_run_flags, limit_flags}))
+		return 1;
+
+	std::ifstream fs{args->files.front()};
+	return run_program(fs, *args);
+}
+
+// Runs a compile, returning why it failed if it did
+template <class F>
+std::optional<std::string>
+compile_error(F &&compile) {
+	std::ostringstream error{};
 	try {
-		std::ofstream bfs{filename, std::ios_base::binary | std::ios_base::trunc};
-		compile(source, bfs);
-	} catch (nori::parse::UnexpectedTokenError err) {
-		std::cerr << "Unexpected token: " << err.actual << ", expected ";
+		compile();
+		return std::nullopt;
+	} catch (nori::parse::UnexpectedTokenError const &err) {
+		error << "Unexpected token: " << err.actual << ", expected ";
+		for (auto const &expected : err.expected)
+			error << expected << ',';
+	} catch (nori::parse::UnexpectedEndOfInput const &err) {
+		error << "Unexpected end of input, expected ";
 		for (auto const &expected : err.expected)
-			std::cerr << expected << ',';
-		std::cerr << '\n';
+			error << expected << ',';
+	} catch (std::runtime_error const &err) {
+		error << err.what();
+	}
+	return std::move(error).str();
+}
+
+// Runs a compile, printing the error if it fails
+template <class F>
+bool
+report_compile_errors(F &&compile) {
+	if (auto const error = compile_error(std::forward<F>(compile))) {
+		std::cerr << *error << '\n';
+		return false;
+	}
+	return true;
+}
+
+// Compiles through `cache` if there is one. Returns the bytecode, or leaves why it doesn't compile in `error`.
+std::optional<std::string>
+compile_cached(std::string_view source, nori::CompileCache *cache, std::string &error) {
+	if (cache) {
+		if (auto cached = cache->load(source))
+			return cached;
+	}
+
+	std::stringstream bytecode{};
+	if (auto failure = compile_error([&] { compile(source, bytecode); })) {
+		error = std::move(*failure);
+		return std::nullopt;
+	}
+
+	auto result = std::move(bytecode).str();
+	if (cache)
+		cache->store(source, result);
+	return result;
+}
+
+// Compiles through the compilation cache unless it's turned off, printing any compile error
+std::optional<std::string>
+compile_source(std::string_view source, bool use_cache) {
+	std::optional<nori::CompileCache> cache{};
+	if (use_cache)
+		cache.emplace();
+
+	std::string error{};
+	auto bytecode = compile_cached(source, cache ? &*cache : nullptr, error);
+	if (!bytecode)
+		std::cerr << error << '\n';
+	return bytecode;
+}
+
+// Adds the .nori files anywhere under `dir` to `found`, and the directories that can't be read to `errors`
+void
+find_sources(
+    std::filesystem::path const &dir, std::vector<std::filesystem::path> &found, std::vector<std::string> &errors) {
+	std::error_code ec;
+	for (std::filesystem::directory_iterator entry{dir, ec}; !ec && entry != std::filesystem::directory_iterator{};
+	     entry.increment(ec)) {
+		// Symlinked directories aren't followed, they could lead back up
+		std::error_code type_ec;
+		if (entry->is_directory(type_ec) && !entry->is_symlink(type_ec))
+			find_sources(entry->path(), found, errors);
+		else if (entry->is_regular_file(type_ec) && entry->path().extension() == ".nori")
+			found.emplace_back(entry->path());
+	}
+	if (ec)
+		errors.push_back(fmt::format("Couldn't read {}: {}", dir.string(), ec.message()));
+}
+
+// Source files named on the command line, with directories replaced by the .nori files anywhere under them. Sources
+// that would be compiled to the same .nr file as an earlier one are left out. Directories that can't be read and
+// different sources sharing an output are added to `errors`.
+std::vector<std::filesystem::path>
+build_sources(std::vector<char const *> const &args, std::vector<std::string> &errors) {
+	std::vector<std::filesystem::path> sources{};
+	for (auto const arg : args) {
+		std::error_code ec;
+		if (!std::filesystem::is_directory(arg, ec)) {
+			sources.emplace_back(arg);
+			continue;
+		}
+
+		std::vector<std::filesystem::path> found{};
+		find_sources(arg, found, errors);
+		// Directory order depends on the filesystem
+		std::sort(found.begin(), found.end());
+		sources.insert(sources.end(), found.begin(), found.end());
+	}
+
+	// Two builds writing the same output would race on it
+	std::map<std::filesystem::path, std::filesystem::path> outputs{};
+	std::erase_if(sources, [&](auto const &source) {
+		std::error_code ec;
+		auto output = std::filesystem::path{source}.replace_extension(".nr");
+		if (auto canonical = std::filesystem::weakly_canonical(output, ec); !ec)
+			output = std::move(canonical);
+		auto const [first, added] = outputs.try_emplace(output, source);
+		if (added)
+			return false;
+		// The same file named twice is only built once, different ones would overwrite each other
+		if (first->second != source && !std::filesystem::equivalent(first->second, source, ec))
+			errors.push_back(
+			    fmt::format("{}: Compiles to the same file as {}", source.string(), first->second.string()));
+		return true;
+	});
+	return sources;
+}
+
+// Compiles `source` to a .nr file next to it. The bytecode is written to a temporary file and renamed into place, so
+// a failed compile leaves nothing half written behind. Returns why it failed if it did.
+std::optional<std::string>
+build_file(
+    std::filesystem::path const &source, std::filesystem::path const &output, RunArgs const &args,
+    nori::CompileCache *cache) {
+	std::ifstream source_stream{source, std::ios_base::binary};
+	if (!source_stream)
+		return fmt::format("Couldn't open {}", source.string());
+
+	auto tmp = output;
+	tmp += fmt::format(".{}.{:x}.tmp", getpid(), std::hash<std::thread::id>{}(std::this_thread::get_id()));
+	std::optional<std::string> error{};
+	{
+		std::ofstream bfs{tmp, std::ios_base::binary | std::ios_base::trunc};
+		if (args.stream) {
+			error = compile_error([&] { compile_stream(source_stream, bfs); });
+		} else {
+			std::string const contents{
+			    std::istreambuf_iterator<char>{source_stream}, std::istreambuf_iterator<char>{}};
+			std::string message{};
+			if (auto const bytecode = compile_cached(contents, cache, message))
+				bfs.write(bytecode->data(), bytecode->size());
+			else
+				error = std::move(message);
+		}
+		if (!error && !bfs)
+			error = fmt::format("Couldn't write {}", tmp.string());
+	}
+
+	std::error_code ec;
+	if (!error) {
+		std::filesystem::rename(tmp, output, ec);
+		if (ec)
+			error = fmt::format("Couldn't write {}: {}", output.string(), ec.message());
+	}
+	if (error)
+		std::filesystem::remove(tmp, ec);
+	return error;
+}
+
+int
+build(int argc, char const **argv) {
+	std::string_view threads_arg{};
+	auto const args = parse_run_args(argc, argv, {{"--threads", &threads_arg}});
+	if (!args)
+		return 1;
+
+	constexpr std::array<std::string_view, 3> build_flags{"--no-cache", "--stream", "--threads"};
+	if (!check_flags(*args, "build", {build_flags}))
 		return 1;
-	} catch (std::runtime_error err) {
-		std::cerr << err.what() << '\n';
+
+	std::size_t threads = 0;
+	if (!threads_arg.empty() && !parse_number("--threads", threads_arg, threads))
+		return 1;
+
+	if (args->files.empty()) {
+		fmt::print("File required\n");
 		return 1;
 	}
 
-	fmt::print("Compiled to {}\n", filename);
-	return 0;
+	std::vector<std::string> listing_errors{};
+	auto const sources = build_sources(args->files, listing_errors);
+	for (auto const &error : listing_errors)
+		fmt::print(stderr, "{}\n", error);
+	std::vector<std::filesystem::path> outputs{};
+	for (auto const &source : sources)
+		outputs.emplace_back(std::filesystem::path{source}.replace_extension(".nr"));
+
+	// The cache only touches files, one can be shared between threads
+	std::optional<nori::CompileCache> cache{};
+	if (args->use_cache)
+		cache.emplace();
+	auto *const cache_ptr = cache ? &*cache : nullptr;
+
+	if (sources.size() == 1 && listing_errors.empty() && !std::filesystem::is_directory(args->files.front())) {
+		if (auto const error = build_file(sources.front(), outputs.front(), *args, cache_ptr)) {
+			fmt::print(stderr, "{}\n", *error);
+			return 1;
+		}
+		fmt::print("Compiled to {}\n", outputs.front().string());
+		return 0;
+	}
+
+	auto const start = std::chrono::steady_clock::now();
+	std::vector<std::optional<std::string>> errors(sources.size());
+	{
+		nori::ThreadPool pool{threads};
+		for (std::size_t i = 0; i < sources.size(); ++i)
+			pool.submit([&, i] { errors[i] = build_file(sources[i], outputs[i], *args, cache_ptr); });
+		pool.wait();
+	}
+	std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+	// Reported in the order the files were given, whatever order they finished in
+	std::size_t failed = 0;
+	for (std::size_t i = 0; i < sources.size(); ++i) {
+		if (errors[i]) {
+			fmt::print(stderr, "{}: {}\n", sources[i].string(), *errors[i]);
+			++failed;
+		}
+	}
+	fmt::print(
+	    stderr, "{} files compiled in {:.3f}s ({:.0f} files/s), {} failed\n", sources.size() - failed,
+	    elapsed.count(), sources.size() / std::max(elapsed.count(), 1e-9), failed);
+	return failed == 0 && listing_errors.empty() ? 0 : 1;
 }
 
 int
 exec(int argc, char const **argv) {
+	auto const args = parse_run_args(argc, argv);
+	if (!args)
+		return 1;
+
+	constexpr std::array<std::string_view, 2> compile_flags{"--no-cache", "--stream"};
+	if (!check_flags(*args, "exec", {local_run_flags, limit_flags, compile_flags}))
+		return 1;
+
+	if (args->stream) {
+		std::ifstream fs{};
+		if (!args->files.empty()) {
+			fs.open(args->files.front(), std::ios_base::binary);
+			if (!fs) {
+				fmt::print(stderr, "Couldn't open {}\n", args->files.front());
+				return 1;
+			}
+		}
+
+		std::stringstream bytecode{};
+		if (!report_compile_errors([&] { compile_stream(args->files.empty() ? std::cin : fs, bytecode); }))
+			return 1;
+		return run_program(bytecode, *args);
+	}
+
 	std::string source;
 
-	if (argc < 2) {
+	if (args->files.empty()) {
 		std::stringstream sourcestream{};
 		sourcestream << std::cin.rdbuf();
 		source = sourcestream.str();
 	} else {
-		std::stringstream sourcestream{};
-		std::ifstream fs{argv[1]};
-		sourcestream << fs.rdbuf();
-		source = sourcestream.str();
+		auto contents = read_file(args->files.front());
+		if (!contents)
+			return 1;
+		source = std::move(*contents);
+	}
+
+	auto const bytecode = compile_source(source, args->use_cache);
+	if (!bytecode)
+		return 1;
+
+	nori::MemoryStream program{*bytecode};
+	return run_program(program, *args);
+}
+
+// Runs a program as it's typed, a line at a time, each line carrying on from the stack and variables the ones before it
+// left. Input ops read the lines after the one running them.
+int
+repl(int argc, char const **argv) {
+	auto const args = parse_run_args(argc, argv);
+	if (!args)
+		return 1;
+
+	constexpr std::array<std::string_view, 1> repl_flags{"--seed"};
+	if (!check_flags(*args, "repl", {repl_flags, limit_flags}))
+		return 1;
+
+	bool const interactive = isatty(STDIN_FILENO);
+	Repl repl{args->options};
+	int status = 0;
+	std::string line{};
+	while (true) {
+		// On stderr, so stdout only has the program's output
+		if (interactive)
+			std::cerr << "> " << std::flush;
+		if (!std::getline(std::cin, line))
+			break;
+
+		auto state = Repl::State::Finished;
+		if (auto const error = compile_error([&] { state = repl.run(line); })) {
+			std::cerr << *error << '\n';
+			status = 1;
+			continue;
+		}
+		while (state == Repl::State::NeedsInput) {
+			std::cout << repl.take_output() << std::flush;
+			state = std::getline(std::cin, line) ? repl.feed(line + '\n') : repl.close();
+		}
+
+		auto const output = repl.take_output();
+		std::cout << output;
+		if (interactive && !output.empty() && output.back() != '\n')
+			std::cout << '\n';
+		std::cout.flush();
+		if (state == Repl::State::Failed) {
+			std::cerr << repl.error() << '\n';
+			status = repl.status();
+		}
 	}
+	return status;
+}
 
-	std::stringstream ss{};
+// Summarises a trace written by --trace, given the bytecode it was recorded from
+int
+trace(int argc, char const **argv) {
+	if (argc != 3) {
+		fmt::print("Trace and bytecode files required\n");
+		return 1;
+	}
+
+	std::ifstream fs{argv[1], std::ios_base::binary};
+	if (!fs) {
+		fmt::print(stderr, "Couldn't open {}\n", argv[1]);
+		return 1;
+	}
+	auto const bytecode = read_file(argv[2]);
+	if (!bytecode)
+		return 1;
 
 	try {
-		compile(source, ss);
-	} catch (nori::parse::UnexpectedTokenError err) {
-		std::cerr << "Unexpected token: " << err.actual << ", expected ";
-		for (auto const &expected : err.expected)
-			std::cerr << expected << ',';
-		std::cerr << '\n';
+		fmt::print("{}", nori::vm::summarize_trace(fs, *bytecode));
+	} catch (std::runtime_error const &err) {
+		fmt::print(stderr, "{}\n", err.what());
+		return 1;
+	}
+	return 0;
+}
+
+void
+print_memo_stats(std::FILE *out, nori::ResultCache::Stats const &stats) {
+	fmt::print(
+	    out, "Memo: {} hits ({} from disk), {} misses, {} evictions ({} from disk), {} results in {} bytes\n",
+	    stats.hits, stats.disk_hits, stats.misses, stats.evictions, stats.disk_evictions, stats.entries, stats.bytes);
+}
+
+namespace {
+
+std::atomic<nori::Server *> serving{nullptr};
+
+void
+stop_serving(int) {
+	if (auto *const server = serving.load())
+		server->stop();
+}
+
+} // namespace
+
+// Runs programs for `run --connect` until interrupted, or with --stats asks a running server how its memo is doing
+int
+serve(int argc, char const **argv) {
+	std::string_view threads_arg{};
+	auto const args = parse_run_args(argc, argv, {{"--threads", &threads_arg}});
+	if (!args)
+		return 1;
+
+	constexpr std::array<std::string_view, 3> serve_flags{"--threads", "--memo", "--stats"};
+	if (!check_flags(*args, "serve", {serve_flags, limit_flags}))
+		return 1;
+
+	std::size_t threads = 0;
+	if (!threads_arg.empty() && !parse_number("--threads", threads_arg, threads))
+		return 1;
+
+	if (args->files.empty()) {
+		fmt::print("Socket path required\n");
+		return 1;
+	}
+
+	if (args->stats) {
+		try {
+			if (auto const stats = nori::remote_memo_stats(args->files.front()))
+				print_memo_stats(stdout, *stats);
+			else
+				fmt::print(stderr, "Not memoizing, start the server with --memo\n");
+		} catch (std::exception const &err) {
+			fmt::print(stderr, "{}\n", err.what());
+			return 1;
+		}
+		return 0;
+	}
+
+	try {
+		// Only kept in memory, the server lives long enough that the disk wouldn't add much
+		std::optional<nori::ResultCache> memo{};
+		if (args->memo)
+			memo.emplace();
+		nori::Server server{args->files.front(), threads, args->options.limits, memo ? &*memo : nullptr};
+		serving = &server;
+		std::signal(SIGINT, stop_serving);
+		std::signal(SIGTERM, stop_serving);
+		fmt::print(stderr, "Listening on {}\n", args->files.front());
+		server.serve();
+		serving = nullptr;
+	} catch (std::exception const &err) {
+		fmt::print(stderr, "{}\n", err.what());
+		return 1;
+	}
+	return 0;
+}
+
+int
+cache(int argc, char const **argv) {
+	nori::CompileCache cache{};
+	std::string_view const action = argc < 2 ? "stats" : argv[1];
+
+	if (action == "stats") {
+		auto const stats = cache.stats();
+		auto const total = stats.hits + stats.misses;
+		fmt::print(
+		    "{}\nhits: {}\nmisses: {}\nhit rate: {:.1f}%\n", cache.directory().string(), stats.hits, stats.misses,
+		    total == 0 ? 0.0 : 100.0 * stats.hits / total);
+		return 0;
+	}
+	if (action == "clear") {
+		cache.clear();
+		return 0;
+	}
+
+	fmt::print("Unknown cache command {}\n", action);
+	return 1;
+}
+
+// Runs one program over many inputs, or many programs over one input
+int
+batch(int argc, char const **argv) {
+	std::string_view input_file{};
+	std::string_view threads_arg{};
+	auto const args = parse_run_args(argc, argv, {{"--input", &input_file}, {"--threads", &threads_arg}});
+	if (!args)
 		return 1;
-	} catch (std::runtime_error err) {
-		std::cerr << err.what() << '\n';
+
+	constexpr std::array<std::string_view, 4> batch_flags{"--input", "--threads", "--seed", "--memo"};
+	if (!check_flags(*args, "batch", {batch_flags, limit_flags}))
+		return 1;
+
+	std::size_t threads = 0;
+	if (!threads_arg.empty() && !parse_number("--threads", threads_arg, threads))
+		return 1;
+
+	if (args->files.empty() || (input_file.empty() && args->files.size() < 2)) {
+		fmt::print("Program and input files required\n");
 		return 1;
 	}
 
-	return run_stream(ss);
+	// Everything is loaded up front so each file is read once however many jobs use it
+	std::vector<std::string> contents{};
+	contents.reserve(args->files.size() + 1);
+	for (auto const file : args->files) {
+		auto data = read_file(file);
+		if (!data)
+			return 1;
+		contents.emplace_back(std::move(*data));
+	}
+
+	std::vector<BatchJob> jobs{};
+	std::vector<std::string_view> names{};
+	if (input_file.empty()) {
+		for (std::size_t i = 1; i < contents.size(); ++i) {
+			jobs.emplace_back(BatchJob{.program = contents.front(), .input = contents[i]});
+			names.emplace_back(args->files[i]);
+		}
+	} else {
+		auto input = read_file(std::string{input_file}.c_str());
+		if (!input)
+			return 1;
+		contents.emplace_back(std::move(*input));
+		for (std::size_t i = 0; i + 1 < contents.size(); ++i) {
+			jobs.emplace_back(BatchJob{.program = contents[i], .input = contents.back()});
+			names.emplace_back(args->files[i]);
+		}
+	}
+
+	auto options = args->options;
+	std::optional<nori::ResultCache> memo{};
+	if (args->memo)
+		options.memo = &memo.emplace(nori::ResultCache::default_memory, nori::ResultCache::default_directory());
+
+	auto const start = std::chrono::steady_clock::now();
+	auto const results = run_batch(jobs, options, threads);
+	std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+	int status = 0;
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		auto const &result = results[i];
+		fmt::print("==> {} ({}) <==\n{}", names[i], result.status, result.output);
+		if (!result.output.empty() && result.output.back() != '\n')
+			fmt::print("\n");
+		if (result.status != 0) {
+			fmt::print(stderr, "{}: {}\n", names[i], result.error);
+			status = 1;
+		}
+	}
+
+	fmt::print(
+	    stderr, "{} jobs in {:.3f}s ({:.0f} jobs/s)\n", results.size(), elapsed.count(),
+	    results.size() / std::max(elapsed.count(), 1e-9));
+	if (memo)
+		print_memo_stats(stderr, memo->stats());
+	return status;
 }
 
 int
 main(int argc, char const **argv) {
+	// Lets the VM pull input from cin in blocks instead of one character at a time
+	std::ios_base::sync_with_stdio(false);
+
 	if (argc > 1) {
 		auto sub = argv[1];
 
@@ -108,11 +938,44 @@ main(int argc, char const **argv) {
 
 		if (std::strcmp("exec", sub) == 0)
 			return exec(argc - 1, argv + 1);
+
+		if (std::strcmp("batch", sub) == 0)
+			return batch(argc - 1, argv + 1);
+
+		if (std::strcmp("repl", sub) == 0)
+			return repl(argc - 1, argv + 1);
+
+		if (std::strcmp("trace", sub) == 0)
+			return trace(argc - 1, argv + 1);
+
+		if (std::strcmp("serve", sub) == 0)
+			return serve(argc - 1, argv + 1);
+
+		if (std::strcmp("cache", sub) == 0)
+			return cache(argc - 1, argv + 1);
 	}
 
 	fmt::print("Usage:\n"
-	           "\tnori run [file]\n"
-	           "\tnori build [file]\n"
-	           "\tnori exec [file]\n");
+	           "\tnori run [run options] [file]\n"
+	           "\tnori build [--no-cache] [--stream] [--threads n] [files or directories...]\n"
+	           "\tnori exec [run options] [--no-cache] [--stream] [file]\n"
+	           "\tnori batch [--seed n] [--threads n] [--memo] [file] [inputs...]\n"
+	           "\tnori batch [--seed n] [--threads n] [--memo] --input [input] [files...]\n"
+	           "\tnori repl [--seed n] [limits]\n"
+	           "\tnori trace [trace] [file.nr]\n"
+	           "\tnori serve [--threads n] [--memo] [limits] [socket]\n"
+	           "\tnori serve --stats [socket]\n"
+	           "\tnori cache [stats|clear]\n"
+	           "Run options:\n"
+	           "\t--seed n\n"
+	           "\t--stats\n"
+	           "\t--profile, --profile-json file\n"
+	           "\t--sample file, --sample-interval us\n"
+	           "\t--trace file\n"
+	           "\t--record file, --replay file\n"
+	           "\t--snapshot file, --restore file\n"
+	           "\t--connect socket\n"
+	           "\t--memo\n"
+	           "\t--fuel n, --max-stack n, --max-string-bytes n, --timeout ms\n");
 	return 1;
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef MEMSTREAM_HPP
+#define MEMSTREAM_HPP
+
+#include <ios>
+#include <istream>
+#include <streambuf>
+#include <string_view>
+
+namespace nori {
+
+// Read only, seekable stream buffer over memory owned by someone else
+class MemoryBuffer : public std::streambuf {
+  public:
+	MemoryBuffer(std::string_view data) {
+		auto *const begin = const_cast<char *>(data.data());
+		setg(begin, begin, begin + data.size());
+	}
+
+  protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+		if (!(which & std::ios_base::in))
+			return pos_type(off_type(-1));
+
+		off_type base = 0;
+		if (dir == std::ios_base::cur)
+			base = gptr() - eback();
+		else if (dir == std::ios_base::end)
+			base = egptr() - eback();
+
+		off_type const pos = base + off;
+		if (pos < 0 || pos > egptr() - eback())
+			return pos_type(off_type(-1));
+		setg(eback(), eback() + pos, egptr());
+		return pos_type(pos);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+};
+
+// Lets bytecode or input that's already in memory be shared between runs without copying it into a stringstream
+class MemoryStream : public std::istream {
+  public:
+	MemoryStream(std::string_view data) : std::istream{nullptr}, _buffer{data} { rdbuf(&_buffer); }
+
+  private:
+	MemoryBuffer _buffer;
+};
+
+} // namespace nori
+
+#endif
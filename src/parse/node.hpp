@@ -2,7 +2,9 @@
 #ifndef AST_HPP
 #define AST_HPP
 
-#include <variant>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "token.hpp"
@@ -32,60 +34,84 @@ namespace nori::parse {
 	X(Rand, RandNode) \
 	X(BitRand, BitRandNode) \
 	X(ByteRand, ByteRandNode) \
-	X(JumpBegin, JumpBeginNode)
-
-class PushNode;
-class PushVar;
-class SetVarPop;
-class SetVarValue;
-class ConditionalNode;
-
-#define X(_, NodeName) \
-	class NodeName {};
-
-XNODES
-
-#undef X
+	X(JumpBegin, JumpBeginNode) \
+	X(Sum, SumNode) \
+	X(Product, ProductNode) \
+	X(Min, MinNode) \
+	X(Max, MaxNode) \
+	X(Range, RangeNode)
+
+// Ops A can apply to every value on the stack, named the same as their tokens, nodes (with Node on the end) and opcodes
+#define XMAPOPS \
+	X(Add) \
+	X(Sub) \
+	X(Mul) \
+	X(Div) \
+	X(Pow) \
+	X(Mod)
 
 #define X(_, NodeName) NodeName,
 
-using Node = std::variant<XNODES PushNode, PushVar, SetVarPop, SetVarValue, ConditionalNode>;
-
-#undef X
-
-class PushNode {
-
-  public:
-	NoriValue const value;
-	PushNode(NoriValue const &value) : value{value} {}
+enum class NodeType : std::uint8_t {
+	XNODES
+	// Push a number
+	PushNode,
+	// Push a string
+	PushString,
+	PushVar,
+	SetVarPop,
+	// |name| followed by a number
+	SetVarNumber,
+	// |name| followed by a string
+	SetVarString,
+	// [ ... ]
+	ConditionalNode,
+	// A followed by one of XMAPOPS, with the op's node type in `arg`
+	MapNode
 };
 
-class PushVar {
-  public:
-	std::string const name;
-	PushVar(std::string const &name) : name{name} {}
-};
+#undef X
 
-class SetVarPop {
-  public:
-	std::string const name;
-	SetVarPop(std::string const &name) : name{name} {}
+// The AST is one flat array of nodes in pre-order. A ConditionalNode's body directly follows it, and its `arg` is the
+// index one past the last node of the body.
+struct Node {
+	NodeType type;
+	// Identifier id for the variable nodes, end of the body for ConditionalNode, the op for MapNode
+	std::uint32_t arg = 0;
+	// Index into Ast::strings for PushString and SetVarString
+	std::uint32_t string = 0;
+	// Value for PushNode and SetVarNumber
+	double number = 0;
 };
 
-class SetVarValue {
-  public:
-	std::string const name;
-	NoriValue const value;
-	SetVarValue(std::string const &name, NoriValue const &value) : name{name}, value{value} {}
+struct Ast {
+	std::vector<Node> nodes;
+	// Identifier names, indexed by id. Ids are handed out in the order the names first appear in the source.
+	std::vector<std::string_view> identifiers;
+	// String literals, views into the source
+	std::vector<std::string_view> strings;
 };
 
-class ConditionalNode {
-
+// Maps identifier names to ids while parsing. Names already in `names` keep their ids.
+class Interner {
   public:
-	std::vector<Node> body;
-	ConditionalNode(std::vector<Node> &&body) : body{std::move(body)} {}
+	Interner(std::vector<std::string_view> &names) : _names{names} {
+		for (std::uint32_t id = 0; id < _names.size(); ++id)
+			_ids.emplace(_names[id], id);
+	}
+
+	std::uint32_t intern(std::string_view name) {
+		auto const [it, inserted] = _ids.try_emplace(name, _names.size());
+		if (inserted)
+			_names.emplace_back(name);
+		return it->second;
+	}
+
+  private:
+	std::vector<std::string_view> &_names;
+	std::unordered_map<std::string_view, std::uint32_t> _ids;
 };
 
 } // namespace nori::parse
 
-#endif
\ No newline at end of file
+#endif
@@ -2,13 +2,19 @@
 #ifndef PARSE_HPP
 #define PARSE_HPP
 
+#include <cstdint>
 #include <exception>
 #include <iostream>
 #include <iterator>
 #include <optional>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
 #include <vector>
 
+#include "../utils.hpp"
 #include "node.hpp"
 #include "token.hpp"
 #include "tokenio.hpp"
@@ -23,66 +29,123 @@ class UnexpectedEndOfInput {
 
 class UnexpectedTokenError {
   public:
-	Token const actual;
+	// Formatted up front, the token's views may not outlive the source
+	std::string const actual;
 	std::vector<TokenType> const expected;
 	UnexpectedTokenError(std::vector<TokenType> &&expected, Token const &actual)
-	    : actual{actual}, expected{std::move(expected)} {}
+	    : actual{describe(actual)}, expected{std::move(expected)} {}
+
+  private:
+	static std::string describe(Token const &tok) {
+		std::ostringstream os{};
+		// Qualified, the operator lives in the global namespace and can be hidden from here
+		::operator<<(os, tok);
+		return std::move(os).str();
+	}
 };
 
+// Node for a literal, picking the number or string flavour of the node type
+inline Node
+value_node(Ast &ast, TokenValue const &value, NodeType number_type, NodeType string_type, std::uint32_t arg = 0) {
+	return std::visit(
+	    overloaded{
+	        [&](double const &number) { return Node{.type = number_type, .arg = arg, .number = number}; },
+	        [&](std::string_view const &str) {
+		        ast.strings.emplace_back(str);
+		        return Node{
+		            .type = string_type, .arg = arg, .string = static_cast<std::uint32_t>(ast.strings.size() - 1)};
+	        }},
+	    value);
+}
+
 template <std::input_iterator Iter>
-Node
-parse_push(Iter &iter, Iter const &end) {
+void
+parse_push(Iter &iter, Iter const &end, Ast &ast, Interner &names) {
 	if (iter == end)
 		throw std::runtime_error{"Unexpected end of input"};
 
-	auto const tok = *iter;
+	auto const &tok = *iter;
 
 	if (tok.type == TokenType::Value) {
+		ast.nodes.emplace_back(value_node(ast, tok.value, NodeType::PushNode, NodeType::PushString));
 		++iter;
-		return PushNode{tok.value};
+		return;
 	} else if (tok.type == TokenType::Identifier) {
+		auto const id = names.intern(std::get<std::string_view>(tok.value));
+		ast.nodes.emplace_back(Node{.type = NodeType::PushVar, .arg = id});
 		++iter;
-		return PushVar{std::get<std::string>(tok.value)};
+		return;
 	}
 
 	throw UnexpectedTokenError({TokenType::Value}, tok);
 }
 
 template <std::input_iterator Iter>
-Node
-parse_var(Iter &iter, Iter const &end) {
-	std::string const name = std::get<std::string>((*iter).value);
+void
+parse_var(Iter &iter, Iter const &end, Ast &ast, Interner &names) {
+	auto const id = names.intern(std::get<std::string_view>((*iter).value));
 	++iter;
 	if (iter == end) {
 		throw UnexpectedEndOfInput{{TokenType::Pop, TokenType::Value}};
 	}
 	switch ((*iter).type) {
-	case TokenType::Pop: ++iter; return SetVarPop{name};
-	case TokenType::Value: {
-		NoriValue const value = (*iter).value;
+	case TokenType::Pop:
+		ast.nodes.emplace_back(Node{.type = NodeType::SetVarPop, .arg = id});
 		++iter;
-		return SetVarValue{name, value};
-	}
+		return;
+	case TokenType::Value:
+		ast.nodes.emplace_back(value_node(ast, (*iter).value, NodeType::SetVarNumber, NodeType::SetVarString, id));
+		++iter;
+		return;
 	default: throw UnexpectedTokenError{{TokenType::Pop, TokenType::Value}, *iter};
 	}
 }
 
+// The op after an A
 template <std::input_iterator Iter>
-std::vector<Node>
-parse(Iter &iter, Iter const &end) {
-	std::vector<Node> nodes{};
+void
+parse_map(Iter &iter, Iter const &end, Ast &ast) {
+#define X(Name) TokenType::Name,
+	if (iter == end)
+		throw UnexpectedEndOfInput{{XMAPOPS}};
+#undef X
+
+	NodeType op;
+	switch ((*iter).type) {
+#define X(Name) \
+	case TokenType::Name: op = NodeType::Name##Node; break;
 
+		XMAPOPS
+#undef X
+#define X(Name) TokenType::Name,
+	default: throw UnexpectedTokenError{{XMAPOPS}, *iter};
+#undef X
+	}
+	ast.nodes.emplace_back(Node{.type = NodeType::MapNode, .arg = static_cast<std::uint32_t>(op)});
+	++iter;
+}
+
+// Parses nodes onto the end of the AST up to the end of input or a ]
+template <std::input_iterator Iter>
+void
+parse_body(Iter &iter, Iter const &end, Ast &ast, Interner &names) {
 	while (iter != end) {
-		Token const tok = *iter;
-		switch (tok.type) {
+		switch ((*iter).type) {
 		case TokenType::Push:
 			++iter;
-			nodes.emplace_back(parse_push(iter, end));
+			parse_push(iter, end, ast, names);
 			break;
-		case TokenType::Identifier: nodes.emplace_back(parse_var(iter, end)); break;
-		case TokenType::LBracket:
+		case TokenType::Identifier: parse_var(iter, end, ast, names); break;
+		case TokenType::Map:
 			++iter;
-			nodes.emplace_back(ConditionalNode{parse(iter, end)});
+			parse_map(iter, end, ast);
+			break;
+		case TokenType::LBracket: {
+			++iter;
+			auto const index = ast.nodes.size();
+			ast.nodes.emplace_back(Node{.type = NodeType::ConditionalNode});
+			parse_body(iter, end, ast, names);
+			ast.nodes[index].arg = ast.nodes.size();
 			if (iter == end) {
 				throw UnexpectedEndOfInput{{TokenType::RBracket}};
 			} else if ((*iter).type != TokenType::RBracket) {
@@ -90,25 +153,34 @@ parse(Iter &iter, Iter const &end) {
 			}
 			++iter;
 			break;
-		case TokenType::RBracket: goto end;
+		}
+		case TokenType::RBracket: return;
 
 #define X(TokenName, NodeName) \
 	case TokenType::TokenName: \
 		++iter; \
-		nodes.emplace_back(NodeName{}); \
+		ast.nodes.emplace_back(Node{.type = NodeType::NodeName}); \
 		break;
 
 			XNODES
 #undef X
 		default:
 #define X(TokenName, _) TokenType::TokenName,
-			throw UnexpectedTokenError{{TokenType::Push, XNODES}, tok};
+			throw UnexpectedTokenError{{TokenType::Push, XNODES TokenType::Map}, *iter};
 #undef X
 		}
 	}
-end:
+}
 
-	return nodes;
+// Identifiers in `identifiers` keep their ids, new ones are numbered after them, so a program can be parsed a piece at
+// a time
+template <std::input_iterator Iter>
+Ast
+parse(Iter &iter, Iter const &end, std::vector<std::string_view> identifiers = {}) {
+	Ast ast{.identifiers = std::move(identifiers)};
+	Interner names{ast.identifiers};
+	parse_body(iter, end, ast, names);
+	return ast;
 }
 
 } // namespace nori::parse
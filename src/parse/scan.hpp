@@ -0,0 +1,180 @@
+#pragma once
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+#include <system_error>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "token.hpp"
+
+namespace nori::parse {
+
+// What the tokenizer does on seeing a character
+enum class CharClass : std::uint8_t { Skip, Symbol, Tilde, Float, Digit, Quote };
+
+inline constexpr std::array<CharClass, 256> char_classes = [] {
+	std::array<CharClass, 256> classes{};
+#define X(Name, Char) classes[static_cast<unsigned char>(Char)] = CharClass::Symbol;
+	XSYMBOLS
+#undef X
+	classes['~'] = CharClass::Tilde;
+	classes['F'] = CharClass::Float;
+	for (char c = '0'; c <= '9'; ++c)
+		classes[c] = CharClass::Digit;
+	classes['|'] = CharClass::Quote;
+	classes['"'] = CharClass::Quote;
+	classes['\''] = CharClass::Quote;
+	return classes;
+}();
+
+inline constexpr std::array<TokenType, 256> symbol_types = [] {
+	std::array<TokenType, 256> types{};
+	types.fill(TokenType::Error);
+#define X(Name, Char) types[static_cast<unsigned char>(Char)] = TokenType::Name;
+	XSYMBOLS
+#undef X
+	return types;
+}();
+
+inline CharClass
+char_class(char c) {
+	return char_classes[static_cast<unsigned char>(c)];
+}
+
+// Scanning helpers, vectorised when the target has SSE2 or AVX2
+
+#if defined(__AVX2__)
+
+using Vector = __m256i;
+inline constexpr std::ptrdiff_t vector_size = 32;
+
+inline unsigned
+match(char const *p, Vector needle) {
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<Vector const *>(p)), needle));
+}
+
+inline Vector
+splat(char c) {
+	return _mm256_set1_epi8(c);
+}
+
+#elif defined(__SSE2__)
+
+using Vector = __m128i;
+inline constexpr std::ptrdiff_t vector_size = 16;
+
+inline unsigned
+match(char const *p, Vector needle) {
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<Vector const *>(p)), needle));
+}
+
+inline Vector
+splat(char c) {
+	return _mm_set1_epi8(c);
+}
+
+#endif
+
+// First c in [cur, end), or end
+inline char const *
+find_char(char const *cur, char const *end, char c) {
+#if defined(__AVX2__) || defined(__SSE2__)
+	auto const needle = splat(c);
+	for (; end - cur >= vector_size; cur += vector_size) {
+		if (auto const mask = match(cur, needle))
+			return cur + std::countr_zero(mask);
+	}
+#endif
+	return std::find(cur, end, c);
+}
+
+// First position in [cur, end) holding two c's in a row, or end
+inline char const *
+find_pair(char const *cur, char const *end, char c) {
+#if defined(__AVX2__) || defined(__SSE2__)
+	auto const needle = splat(c);
+	for (; end - cur > vector_size; cur += vector_size) {
+		if (auto const mask = match(cur, needle) & match(cur + 1, needle))
+			return cur + std::countr_zero(mask);
+	}
+#endif
+	for (; end - cur >= 2; ++cur) {
+		if (cur[0] == c && cur[1] == c)
+			return cur;
+	}
+	return end;
+}
+
+// First character in [cur, end) that isn't skipped, or end
+inline char const *
+skip_unknown(char const *cur, char const *end) {
+	while (cur != end && char_class(*cur) == CharClass::Skip)
+		++cur;
+	return cur;
+}
+
+// Reads the number starting at cur into tok, returning where it ends
+inline char const *
+scan_number(char const *cur, char const *end, bool is_double, Token &tok) {
+	auto const begin = cur;
+	while (cur != end && char_class(*cur) == CharClass::Digit)
+		++cur;
+	if (is_double && cur != end && *cur == '.') {
+		++cur;
+		while (cur != end && char_class(*cur) == CharClass::Digit)
+			++cur;
+	}
+	double res;
+	auto const [_, ec] = std::from_chars(begin, cur, res);
+	if (ec == std::errc::invalid_argument || ec == std::errc::result_out_of_range) {
+		tok = {.type = TokenType::Error};
+		return cur;
+	}
+	tok = {.type = TokenType::Value, .value = res};
+	return cur;
+}
+
+// Reads the token starting at cur into tok, returning where it ends. Skipped characters and comments have to be dealt
+// with by the caller, so a ~ here is always a lone one.
+inline char const *
+scan_token(char const *cur, char const *end, Token &tok) {
+	switch (char_class(*cur)) {
+	case CharClass::Symbol: tok = {.type = symbol_types[static_cast<unsigned char>(*cur)]}; return cur + 1;
+	case CharClass::Tilde:
+		// A lone ~ reads like an F, skipping the character after it
+		++cur;
+		if (cur != end)
+			++cur;
+		return scan_number(cur, end, true, tok);
+	case CharClass::Float: return scan_number(cur + 1, end, true, tok);
+	case CharClass::Digit: return scan_number(cur, end, false, tok);
+	case CharClass::Quote: {
+		char const quote_char = *cur;
+		auto const begin = cur + 1;
+		auto const close = find_char(begin, end, quote_char);
+
+		std::string_view const text{begin, static_cast<std::size_t>(close - begin)};
+		if (quote_char == '|')
+			tok = {.type = TokenType::Identifier, .value = text};
+		else
+			tok = {.type = TokenType::Value, .value = text};
+		return close == end ? end : close + 1;
+	}
+	case CharClass::Skip: break;
+	}
+	tok = {.type = TokenType::Error};
+	return cur + 1;
+}
+
+} // namespace nori::parse
+
+#endif
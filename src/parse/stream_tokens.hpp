@@ -0,0 +1,117 @@
+#pragma once
+#ifndef STREAM_TOKENS_HPP
+#define STREAM_TOKENS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <istream>
+#include <vector>
+
+#include "scan.hpp"
+#include "token.hpp"
+
+namespace nori::parse {
+
+// Tokenizer reading its source from a stream in chunks, for sources too big to hold in memory.
+//
+// Produces the same tokens as Tokens. Only the current token has to fit in the buffer, comments are skipped as they
+// stream past.
+class StreamTokens {
+  public:
+	static constexpr std::size_t chunk_size = 64 * 1024;
+
+	StreamTokens(std::istream &source) : _source{source}, _buffer(chunk_size), _cur{0}, _end{0}, _eof{false} {}
+
+	// Moves to the next token, returning false at the end of input. The token, and the views in it, are only valid
+	// until the next call.
+	bool next() {
+		while (true) {
+			if (_cur == _end && !refill(_cur))
+				return false;
+
+			char const *const begin = _buffer.data() + _cur;
+			char const *const end = _buffer.data() + _end;
+			switch (char_class(*begin)) {
+			case CharClass::Skip: _cur = skip_unknown(begin + 1, end) - _buffer.data(); continue;
+			case CharClass::Tilde:
+				// Need both characters to tell a comment from a lone ~
+				if (_end - _cur < 2 && !_eof) {
+					refill(_cur);
+					continue;
+				}
+				if (_end - _cur >= 2 && begin[1] == '~') {
+					if (skip_comment())
+						continue;
+					_token = {.type = TokenType::Error};
+					return true;
+				}
+				break;
+			default: break;
+			}
+
+			auto const stop = scan_token(begin, end, _token);
+			// The token could carry on past what's been read so far, scan it again with more input. Refilling moves the
+			// buffer, so it's scanned again even if nothing more was read.
+			if (stop == end && !_eof) {
+				refill(_cur);
+				continue;
+			}
+			_cur = stop - _buffer.data();
+			return true;
+		}
+	}
+
+	Token const &current() const { return _token; }
+
+  private:
+	std::istream &_source;
+	std::vector<char> _buffer;
+	std::size_t _cur;
+	std::size_t _end;
+	bool _eof;
+	Token _token;
+
+	// Drops everything before `keep` and reads more after what's left. False if there was nothing left to read.
+	bool refill(std::size_t keep) {
+		if (_eof)
+			return false;
+
+		std::copy(_buffer.begin() + keep, _buffer.begin() + _end, _buffer.begin());
+		_end -= keep;
+		_cur = _cur > keep ? _cur - keep : 0;
+		if (_end == _buffer.size())
+			_buffer.resize(_buffer.size() * 2);
+
+		std::streamsize const requested = _buffer.size() - _end;
+		_source.read(_buffer.data() + _end, requested);
+		std::streamsize const read = _source.gcount();
+		_end += read;
+		_eof = read < requested;
+		return read > 0;
+	}
+
+	// Skips the comment opening at _cur. False if the input ends before it's closed.
+	bool skip_comment() {
+		std::size_t search = _cur + 2;
+		while (true) {
+			auto const *const data = _buffer.data();
+			auto const close = find_pair(data + search, data + _end, '~');
+			if (close != data + _end) {
+				_cur = close + 2 - data;
+				return true;
+			}
+
+			// Keep the last character, it could be the first half of the terminator
+			std::size_t const keep = std::max(search, _end - 1);
+			if (!refill(keep)) {
+				_cur = _end;
+				return false;
+			}
+			search = 0;
+		}
+	}
+};
+
+} // namespace nori::parse
+
+#endif
@@ -3,6 +3,8 @@
 #define TOKEN_HPP
 
 #include <optional>
+#include <string_view>
+#include <variant>
 
 #include "../common.hpp"
 
@@ -33,6 +35,12 @@ namespace nori::parse {
 	X(BitRand, 'b') \
 	X(ByteRand, 'B') \
 	X(JumpBegin, 'W') \
+	X(Sum, 'S') \
+	X(Product, 'P') \
+	X(Min, 'm') \
+	X(Max, 'M') \
+	X(Range, 'R') \
+	X(Map, 'A') \
 	X(LBracket, '[') \
 	X(RBracket, ']') \
 	X(Question, '?') \
@@ -43,9 +51,12 @@ enum class TokenType { Value, Identifier, Error, XSYMBOLS };
 
 #undef X
 
+// Strings and identifiers are views into the source, which has to outlive the tokens and anything built from them
+using TokenValue = std::variant<double, std::string_view>;
+
 struct Token {
 	TokenType type;
-	std::variant<double, std::string> value;
+	TokenValue value;
 };
 
 } // namespace nori::parse
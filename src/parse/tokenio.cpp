@@ -19,7 +19,7 @@ operator<<(std::ostream &os, nori::parse::Token const &tok) {
 		std::visit(
 		    overloaded{
 		        [&](double const &val) { os << "double(" << val << ')'; },
-		        [&](std::string const &val) {
+		        [&](std::string_view const &val) {
 			        os << "String(\"";
 			        for (auto const &c : val) {
 				        switch (c) {
@@ -36,11 +36,11 @@ operator<<(std::ostream &os, nori::parse::Token const &tok) {
 		std::visit(
 		    overloaded{
 		        [&](double const &val) { throw std::runtime_error{"Identifier should have a string value"}; },
-		        [&](std::string const &val) { os << "Var(" << val << ')'; }},
+		        [&](std::string_view const &val) { os << "Var(" << val << ')'; }},
 		    tok.value);
 		break;
 	case nori::parse::TokenType::Error: os << "Error"; break;
-	default: throw new std::runtime_error{"Unhandled token type"};
+	default: throw std::runtime_error{"Unhandled token type"};
 	}
 	return os;
 }
@@ -53,7 +53,7 @@ operator<<(std::ostream &os, nori::parse::TokenType const &ty) {
 	case nori::parse::TokenType::Value: os << "Value"; break;
 	case nori::parse::TokenType::Identifier: os << "Identifier"; break;
 	case nori::parse::TokenType::Error: os << "Error"; break;
-	default: throw new std::runtime_error{"Unhandled token type"};
+	default: throw std::runtime_error{"Unhandled token type"};
 	}
 
 	return os;
@@ -2,12 +2,10 @@
 #ifndef TOKENITER_HPP
 #define TOKENITER_HPP
 
-#include <charconv>
 #include <cstddef>
-#include <sstream>
 #include <string_view>
-#include <system_error>
 
+#include "scan.hpp"
 #include "token.hpp"
 
 namespace nori::parse {
@@ -19,7 +17,7 @@ class Tokens {
 	Tokens(std::string_view const &source) : _source(source) {}
 
 	class iterator {
-		using InnerIterator = std::string_view::const_iterator;
+		using InnerIterator = char const *;
 
 	  private:
 		InnerIterator _end;
@@ -32,74 +30,21 @@ class Tokens {
 
 		iterator &operator++() {
 			while (_cur != _end) {
-				bool is_double = false;
-				switch (*_cur) {
-
-#define X(Name, Symbol) \
-	case Symbol: \
-		++_cur; \
-		_currentToken = {.type = TokenType::Name}; \
-		break;
-
-					XSYMBOLS
-
-#undef X
-				case '~':
-					++_cur;
-					if (_cur != _end && *_cur == '~') {
-						while (_cur != _end) {
-							++_cur;
-							if (*_cur == '~') {
-								++_cur;
-								if (_cur != _end && *_cur == '~')
-									break;
-							}
-						}
-						if (_cur == _end) {
+				switch (char_class(*_cur)) {
+				case CharClass::Skip: _cur = skip_unknown(_cur + 1, _end); continue;
+				case CharClass::Tilde:
+					if (_cur + 1 != _end && _cur[1] == '~') {
+						auto const close = find_pair(_cur + 2, _end, '~');
+						if (close == _end) {
+							_cur = _end;
 							_currentToken = {.type = TokenType::Error};
 							return *this;
-						} else {
-							++_cur;
 						}
+						_cur = close + 2;
 						continue;
 					}
-				case 'F': is_double = true; ++_cur;
-				case '0' ... '9': {
-					auto const begin = _cur;
-					while (_cur != _end && '0' <= *_cur && *_cur <= '9')
-						++_cur;
-					if (is_double && _cur != _end && *_cur == '.') {
-						++_cur;
-						while (_cur != _end && '0' <= *_cur && *_cur <= '9')
-							++_cur;
-					}
-					std::string_view const view{begin, _cur};
-					double res;
-					auto const [_, ec] = std::from_chars(view.data(), view.data() + view.size(), res);
-					if (ec == std::errc::invalid_argument || ec == std::errc::result_out_of_range) {
-						_currentToken = {.type = TokenType::Error};
-						break;
-					}
-					_currentToken = {.type = TokenType::Value, .value = res};
-					break;
-				}
-				case '|':
-				case '"':
-				case '\'': {
-					char const quote_char = *_cur;
-					++_cur;
-					auto const begin = _cur;
-					while (_cur != _end && *_cur != quote_char)
-						++_cur;
-
-					if (quote_char == '|')
-						_currentToken = {.type = TokenType::Identifier, .value = std::string{begin, _cur}};
-					else
-						_currentToken = {.type = TokenType::Value, .value = std::string{begin, _cur}};
-					++_cur;
-					break;
-				}
-				default: ++_cur; continue;
+					[[fallthrough]];
+				default: _cur = scan_token(_cur, _end, _currentToken); break;
 				}
 				return *this;
 			}
@@ -113,7 +58,7 @@ class Tokens {
 		};
 		bool operator==(iterator other) const { return this->_cur == other._cur && this->_ended == other._ended; }
 		bool operator!=(iterator other) const { return !(*this == other); }
-		Token operator*() const { return _currentToken; }
+		Token const &operator*() const { return _currentToken; }
 
 		// iterator traits
 		using difference_type = std::ptrdiff_t;
@@ -123,8 +68,8 @@ class Tokens {
 		using iterator_category = std::forward_iterator_tag;
 	};
 
-	iterator begin() { return iterator(std::end(_source), std::begin(_source)); }
-	iterator end() { return iterator(std::end(_source), std::end(_source)); }
+	iterator begin() { return iterator(_source.data() + _source.size(), _source.data()); }
+	iterator end() { return iterator(_source.data() + _source.size(), _source.data() + _source.size()); }
 };
 
 } // namespace nori::parse
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "cache.hpp"
+#include "hash.hpp"
+#include "result_cache.hpp"
+
+namespace nori {
+
+namespace {
+
+constexpr std::string_view magic = "NORM";
+constexpr std::uint64_t check_basis = 0x84222325cbf29ce4;
+
+std::uint64_t
+hash(std::string_view program, std::string_view input, std::string_view limits, std::uint64_t basis) {
+	return Hasher{basis}.field(program).field(input).field(limits).digest();
+}
+
+std::string
+bytes_of(std::uint64_t value) {
+	auto const bytes = std::bit_cast<std::array<char, 8>>(value);
+	return {bytes.begin(), bytes.end()};
+}
+
+std::uint64_t
+u64_at(std::string_view data, std::size_t pos) {
+	std::array<char, 8> bytes{};
+	std::copy_n(data.begin() + pos, bytes.size(), bytes.begin());
+	return std::bit_cast<std::uint64_t>(bytes);
+}
+
+} // namespace
+
+std::filesystem::path
+ResultCache::default_directory() {
+	return CompileCache::default_directory() / "results";
+}
+
+ResultCache::ResultCache(std::size_t memory, std::optional<std::filesystem::path> directory, std::size_t disk)
+    : _capacity{memory}, _directory{std::move(directory)}, _disk_capacity{disk} {}
+
+ResultCache::Key
+ResultCache::key(std::string_view program, std::string_view input, nori::vm::Limits const &limits) {
+	// The time limit is left out, a run that finished in time would have finished under any limit
+	auto const fields = fmt::format("{} {} {}", limits.fuel, limits.stack, limits.string_bytes);
+	return Key{
+	    .hash = hash(program, input, fields, Hasher::default_basis),
+	    .check = hash(program, input, fields, check_basis)};
+}
+
+std::size_t
+ResultCache::size(Entry const &entry) {
+	return sizeof(Entry) + entry.result.output.size() + entry.result.error.size();
+}
+
+std::optional<RunResult>
+ResultCache::load(std::string_view program, std::string_view input, nori::vm::Limits const &limits) {
+	auto const k = key(program, input, limits);
+	{
+		std::lock_guard const lock{_mutex};
+		if (auto const found = _index.find(k.hash); found != _index.end() && found->second->check == k.check) {
+			_entries.splice(_entries.begin(), _entries, found->second);
+			++_stats.hits;
+			return found->second->result;
+		}
+	}
+
+	if (_directory) {
+		if (auto result = load_file(k)) {
+			std::lock_guard const lock{_mutex};
+			++_stats.hits;
+			++_stats.disk_hits;
+			insert(Entry{.hash = k.hash, .check = k.check, .result = *result});
+			return result;
+		}
+	}
+
+	std::lock_guard const lock{_mutex};
+	++_stats.misses;
+	return std::nullopt;
+}
+
+void
+ResultCache::store(
+    std::string_view program, std::string_view input, nori::vm::Limits const &limits, RunResult const &result) {
+	// Running out of time depends on more than the program and its input
+	if (result.status == limit_exceeded_status && limits.time != std::chrono::nanoseconds::max())
+		return;
+
+	auto const k = key(program, input, limits);
+	{
+		std::lock_guard const lock{_mutex};
+		insert(Entry{.hash = k.hash, .check = k.check, .result = result});
+	}
+	if (_directory)
+		store_file(k, result);
+}
+
+ResultCache::Stats
+ResultCache::stats() const {
+	std::lock_guard const lock{_mutex};
+	return _stats;
+}
+
+void
+ResultCache::insert(Entry &&entry) {
+	if (auto const found = _index.find(entry.hash); found != _index.end()) {
+		_stats.bytes -= size(*found->second);
+		_entries.erase(found->second);
+		_index.erase(found);
+	}
+
+	auto const entry_size = size(entry);
+	// Bigger than the whole cache, it would only push everything else out
+	if (entry_size > _capacity)
+		return;
+	while (_stats.bytes + entry_size > _capacity) {
+		_stats.bytes -= size(_entries.back());
+		_index.erase(_entries.back().hash);
+		_entries.pop_back();
+		++_stats.evictions;
+	}
+
+	_entries.emplace_front(std::move(entry));
+	_index.emplace(_entries.front().hash, _entries.begin());
+	_stats.bytes += entry_size;
+	_stats.entries = _entries.size();
+}
+
+// Entries are the magic, the check hash, the status and the error's length, then the error and the output
+std::optional<RunResult>
+ResultCache::load_file(Key const &key) const {
+	auto const path = *_directory / fmt::format("{:016x}.res", key.hash);
+	std::ifstream fs{path, std::ios_base::binary};
+	if (!fs)
+		return std::nullopt;
+	std::string const contents{std::istreambuf_iterator<char>{fs}, std::istreambuf_iterator<char>{}};
+	// Trimming goes by modification time, this keeps results that are still read around
+	std::error_code ec;
+	std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+	auto const header = magic.size() + 3 * 8;
+	if (contents.size() < header || !contents.starts_with(magic) || u64_at(contents, magic.size()) != key.check)
+		return std::nullopt;
+	auto const status = u64_at(contents, magic.size() + 8);
+	auto const error_size = u64_at(contents, magic.size() + 16);
+	if (contents.size() - header < error_size)
+		return std::nullopt;
+
+	return RunResult{
+	    .status = static_cast<int>(status),
+	    .output = contents.substr(header + error_size),
+	    .error = contents.substr(header, error_size)};
+}
+
+void
+ResultCache::store_file(Key const &key, RunResult const &result) {
+	std::error_code ec;
+	std::filesystem::create_directories(*_directory, ec);
+	if (ec)
+		return;
+
+	auto const path = *_directory / fmt::format("{:016x}.res", key.hash);
+	auto tmp = path;
+	tmp += fmt::format(".{}.{:x}.tmp", getpid(), std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+	{
+		std::ofstream fs{tmp, std::ios_base::binary | std::ios_base::trunc};
+		fs << magic << bytes_of(key.check) << bytes_of(static_cast<std::uint64_t>(result.status))
+		   << bytes_of(result.error.size()) << result.error << result.output;
+		if (!fs) {
+			fs.close();
+			std::filesystem::remove(tmp, ec);
+			return;
+		}
+	}
+
+	std::filesystem::rename(tmp, path, ec);
+	if (ec) {
+		std::filesystem::remove(tmp, ec);
+		return;
+	}
+
+	// Listing the directory costs more than a store, so it's only done once an eighth of the limit has been written.
+	// Whichever thread crosses that does it.
+	auto const written = magic.size() + 3 * 8 + result.error.size() + result.output.size();
+	auto const step = std::max<std::size_t>(_disk_capacity / 8, 1);
+	if (_written.fetch_add(written) + written >= step && _written.exchange(0) >= step)
+		trim_directory();
+}
+
+void
+ResultCache::trim_directory() {
+	struct File {
+		std::filesystem::file_time_type modified;
+		std::uintmax_t size;
+		std::filesystem::path path;
+	};
+
+	std::vector<File> files{};
+	std::uintmax_t total = 0;
+	std::error_code ec;
+	for (std::filesystem::directory_iterator entry{*_directory, ec};
+	     !ec && entry != std::filesystem::directory_iterator{}; entry.increment(ec)) {
+		if (entry->path().extension() != ".res")
+			continue;
+		std::error_code file_ec;
+		File file{
+		    .modified = entry->last_write_time(file_ec), .size = entry->file_size(file_ec), .path = entry->path()};
+		if (file_ec)
+			continue;
+		total += file.size;
+		files.push_back(std::move(file));
+	}
+	if (total <= _disk_capacity)
+		return;
+
+	std::sort(files.begin(), files.end(), [](auto const &a, auto const &b) { return a.modified < b.modified; });
+	std::uint64_t removed = 0;
+	for (auto const &file : files) {
+		if (total <= _disk_capacity)
+			break;
+		// Another process may have got to it first
+		if (std::filesystem::remove(file.path, ec))
+			++removed;
+		total -= file.size;
+	}
+
+	std::lock_guard const lock{_mutex};
+	_stats.disk_evictions += removed;
+}
+
+} // namespace nori
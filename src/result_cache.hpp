@@ -0,0 +1,93 @@
+#pragma once
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "api.hpp"
+
+namespace nori {
+
+// Results of deterministic runs, keyed by a hash of the bytecode, the input and the limits that decide how a run ends.
+// run_memory() only uses it for programs without random ops and without any hooks (see RunOptions::memo).
+//
+// Recently used results are kept in memory up to a size in bytes, least recently used going first. With a directory
+// they're also written there the same way CompileCache writes bytecode, so other processes can use them, and results
+// that aren't in memory are looked for there. The directory is held to its own size, every so often the results read
+// or written longest ago are removed until it fits. Safe to share between threads.
+class ResultCache {
+  public:
+	static constexpr std::size_t default_memory = 64 * 1024 * 1024;
+	static constexpr std::size_t default_disk = 1024 * 1024 * 1024;
+
+	struct Stats {
+		std::uint64_t hits = 0;
+		// Hits that had to be read from the directory, counted in hits too
+		std::uint64_t disk_hits = 0;
+		std::uint64_t misses = 0;
+		std::uint64_t evictions = 0;
+		// Files this cache removed from the directory
+		std::uint64_t disk_evictions = 0;
+		std::size_t entries = 0;
+		std::size_t bytes = 0;
+	};
+
+	// CompileCache's default directory, under results/
+	static std::filesystem::path default_directory();
+
+	ResultCache(
+	    std::size_t memory = default_memory, std::optional<std::filesystem::path> directory = std::nullopt,
+	    std::size_t disk = default_disk);
+
+	std::optional<RunResult> load(std::string_view program, std::string_view input, nori::vm::Limits const &limits);
+	void store(
+	    std::string_view program, std::string_view input, nori::vm::Limits const &limits, RunResult const &result);
+
+	// Counts for this cache object, not for everything that's used the directory
+	Stats stats() const;
+
+  private:
+	struct Key {
+		std::uint64_t hash;
+		// Second, independent hash, so a collision can't hand back the wrong result
+		std::uint64_t check;
+	};
+
+	struct Entry {
+		std::uint64_t hash;
+		std::uint64_t check;
+		RunResult result;
+	};
+
+	std::size_t const _capacity;
+	std::optional<std::filesystem::path> const _directory;
+	std::size_t const _disk_capacity;
+	// Written to the directory since it was last trimmed
+	std::atomic<std::size_t> _written{0};
+
+	mutable std::mutex _mutex;
+	std::list<Entry> _entries;
+	std::unordered_map<std::uint64_t, std::list<Entry>::iterator> _index;
+	Stats _stats;
+
+	static Key key(std::string_view program, std::string_view input, nori::vm::Limits const &limits);
+	static std::size_t size(Entry const &entry);
+	// Needs the lock
+	void insert(Entry &&entry);
+	std::optional<RunResult> load_file(Key const &key) const;
+	void store_file(Key const &key, RunResult const &result);
+	void trim_directory();
+};
+
+} // namespace nori
+
+#endif
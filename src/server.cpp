@@ -0,0 +1,569 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "parse/parse.hpp"
+#include "server.hpp"
+
+namespace nori {
+
+namespace {
+
+enum Frame : char {
+	// Client to server
+	Program = 'p',
+	Seed = 's',
+	Limits = 'l',
+	Input = 'i',
+	End = 'e',
+	// Both ways
+	MemoStats = 'm',
+	// Server to client
+	Output = 'o',
+	Status = 'x',
+};
+
+constexpr std::size_t max_frame = std::size_t{1} << 30;
+constexpr std::size_t chunk_size = 64 * 1024;
+// Most a client can send for one run, the program's path and input included
+constexpr std::size_t max_request = std::size_t{64} << 20;
+// How long a client has to send its request, and how long sending it output can block before it's given up on
+constexpr auto client_timeout = std::chrono::seconds{10};
+constexpr std::size_t header_size = 5;
+
+struct RequestTooBig : std::runtime_error {
+	RequestTooBig() : std::runtime_error{"Request too big"} {}
+};
+
+// Closes a file descriptor when it goes out of scope
+class Descriptor {
+  public:
+	explicit Descriptor(int fd) : _fd{fd} {}
+	Descriptor(Descriptor &&other) : _fd{other.release()} {}
+	Descriptor(Descriptor const &) = delete;
+	Descriptor &operator=(Descriptor const &) = delete;
+	~Descriptor() {
+		if (_fd >= 0)
+			::close(_fd);
+	}
+
+	int get() const { return _fd; }
+	int release() { return std::exchange(_fd, -1); }
+
+  private:
+	int _fd;
+};
+
+[[noreturn]] void
+throw_errno(char const *what) {
+	throw std::system_error{errno, std::generic_category(), what};
+}
+
+void
+send_all(int fd, char const *data, std::size_t size) {
+	while (size > 0) {
+		// No SIGPIPE if the other end has gone, just an error
+		auto const sent = ::send(fd, data, size, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			throw_errno("send");
+		}
+		data += sent;
+		size -= sent;
+	}
+}
+
+// False if the connection closed before anything was read
+bool
+recv_all(int fd, char *data, std::size_t size) {
+	std::size_t done = 0;
+	while (done < size) {
+		auto const received = ::recv(fd, data + done, size - done, 0);
+		if (received < 0) {
+			if (errno == EINTR)
+				continue;
+			throw_errno("recv");
+		}
+		if (received == 0) {
+			if (done == 0)
+				return false;
+			throw std::runtime_error{"Connection closed in the middle of a frame"};
+		}
+		done += received;
+	}
+	return true;
+}
+
+std::array<char, header_size>
+frame_header(Frame type, std::size_t size) {
+	std::array<char, header_size> header{type};
+	for (int i = 0; i < 4; ++i)
+		header[1 + i] = static_cast<char>((size >> (8 * i)) & 0xff);
+	return header;
+}
+
+std::size_t
+frame_size(char const *header) {
+	std::size_t size = 0;
+	for (int i = 3; i >= 0; --i)
+		size = (size << 8) | static_cast<std::uint8_t>(header[1 + i]);
+	return size;
+}
+
+void
+write_frame(int fd, Frame type, std::string_view data) {
+	auto const header = frame_header(type, data.size());
+	send_all(fd, header.data(), header.size());
+	send_all(fd, data.data(), data.size());
+}
+
+std::optional<std::pair<Frame, std::string>>
+read_frame(int fd) {
+	std::array<char, header_size> header{};
+	if (!recv_all(fd, header.data(), header.size()))
+		return std::nullopt;
+	auto const size = frame_size(header.data());
+	if (size > max_frame)
+		throw std::runtime_error{"Frame too big"};
+	std::string data(size, '\0');
+	if (size > 0 && !recv_all(fd, data.data(), size))
+		throw std::runtime_error{"Connection closed in the middle of a frame"};
+	return std::pair{static_cast<Frame>(header[0]), std::move(data)};
+}
+
+void
+put_u64(std::string &out, std::uint64_t value) {
+	for (int i = 0; i < 8; ++i, value >>= 8)
+		out.push_back(static_cast<char>(value & 0xff));
+}
+
+std::uint64_t
+get_u64(std::string_view data, std::size_t index) {
+	if (data.size() < (index + 1) * 8)
+		throw std::runtime_error{"Frame too short"};
+	std::uint64_t value = 0;
+	for (int i = 7; i >= 0; --i)
+		value = (value << 8) | static_cast<std::uint8_t>(data[index * 8 + i]);
+	return value;
+}
+
+// The status frame ending a run, header included
+std::string
+status_frame(int status, std::string_view error) {
+	std::string data{};
+	put_u64(data, static_cast<std::uint64_t>(status));
+	data += error;
+	auto const header = frame_header(Frame::Status, data.size());
+	return std::string{header.data(), header.size()} + data;
+}
+
+// Sends what the program writes as output frames, a block at a time
+class FrameBuffer : public std::streambuf {
+  public:
+	FrameBuffer(int fd) : _fd{fd}, _buffer(chunk_size) { setp(_buffer.data(), _buffer.data() + _buffer.size()); }
+
+  protected:
+	int_type overflow(int_type c) override {
+		send();
+		if (!traits_type::eq_int_type(c, traits_type::eof()))
+			sputc(traits_type::to_char_type(c));
+		return traits_type::not_eof(c);
+	}
+
+	int sync() override {
+		send();
+		return 0;
+	}
+
+  private:
+	int _fd;
+	std::vector<char> _buffer;
+
+	void send() {
+		if (pptr() != pbase())
+			write_frame(_fd, Frame::Output, {pbase(), static_cast<std::size_t>(pptr() - pbase())});
+		setp(_buffer.data(), _buffer.data() + _buffer.size());
+	}
+};
+
+// Compiles source, or throws std::runtime_error saying why it doesn't compile
+std::string
+compile_source(std::string_view source) {
+	std::ostringstream bytecode{};
+	std::ostringstream error{};
+	try {
+		compile(source, bytecode);
+		return std::move(bytecode).str();
+	} catch (parse::UnexpectedTokenError const &err) {
+		error << "Unexpected token: " << err.actual << ", expected ";
+		for (auto const &expected : err.expected)
+			error << expected << ',';
+	} catch (parse::UnexpectedEndOfInput const &err) {
+		error << "Unexpected end of input, expected ";
+		for (auto const &expected : err.expected)
+			error << expected << ',';
+	}
+	throw std::runtime_error{std::move(error).str()};
+}
+
+sockaddr_un
+socket_address(std::filesystem::path const &path) {
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	auto const &name = path.native();
+	if (name.size() >= sizeof(address.sun_path))
+		throw std::runtime_error{"Socket path too long: " + name};
+	std::copy(name.begin(), name.end(), address.sun_path);
+	return address;
+}
+
+// Connected to the server listening on `socket`
+Descriptor
+connect_to(std::filesystem::path const &socket) {
+	auto const address = socket_address(socket);
+	Descriptor connection{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+	if (connection.get() < 0)
+		throw_errno("socket");
+	if (::connect(connection.get(), reinterpret_cast<sockaddr const *>(&address), sizeof(address)) < 0)
+		throw std::system_error{errno, std::generic_category(), socket.string()};
+	return connection;
+}
+
+} // namespace
+
+std::shared_ptr<std::string const>
+ProgramCache::get(std::filesystem::path const &path) {
+	std::error_code ec{};
+	auto const modified = std::filesystem::last_write_time(path, ec);
+	if (ec)
+		throw std::runtime_error{"Couldn't open " + path.string()};
+
+	{
+		std::lock_guard const lock{_mutex};
+		if (auto const found = _entries.find(path.native());
+		    found != _entries.end() && found->second.modified == modified)
+			return found->second.bytecode;
+	}
+
+	// Compiled without the lock, two threads compiling the same changed file only cost some duplicated work
+	std::ifstream fs{path, std::ios_base::binary};
+	if (!fs)
+		throw std::runtime_error{"Couldn't open " + path.string()};
+	std::string contents{std::istreambuf_iterator<char>{fs}, std::istreambuf_iterator<char>{}};
+	auto bytecode =
+	    std::make_shared<std::string const>(path.extension() == ".nr" ? std::move(contents) : compile_source(contents));
+
+	std::lock_guard const lock{_mutex};
+	_entries.insert_or_assign(path.native(), Entry{modified, bytecode});
+	return bytecode;
+}
+
+Server::Server(std::filesystem::path socket, std::size_t threads, vm::Limits const &limits, ResultCache *memo)
+    : _path{std::move(socket)}, _limits{limits}, _memo{memo}, _pool{threads} {
+	auto const address = socket_address(_path);
+	_socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (_socket < 0)
+		throw_errno("socket");
+	::unlink(_path.c_str());
+	if (::bind(_socket, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) < 0 ||
+	    ::listen(_socket, SOMAXCONN) < 0) {
+		auto const error = errno;
+		::close(_socket);
+		throw std::system_error{error, std::generic_category(), _path.string()};
+	}
+}
+
+Server::~Server() {
+	stop();
+	_pool.wait();
+	::close(_socket);
+	::unlink(_path.c_str());
+}
+
+class Server::Incoming {
+  public:
+	explicit Incoming(int fd) : _connection{fd}, _deadline{std::chrono::steady_clock::now() + client_timeout} {}
+
+	int fd() const { return _connection.get(); }
+	std::chrono::steady_clock::time_point deadline() const { return _deadline; }
+
+	// Takes whatever has arrived without waiting for more. True once the end frame is in, throws if the client went
+	// away, sent something that isn't a request or sent too much.
+	bool read() {
+		while (true) {
+			auto const old = _buffer.size();
+			_buffer.resize(old + chunk_size);
+			auto const received = ::recv(fd(), _buffer.data() + old, chunk_size, MSG_DONTWAIT);
+			_buffer.resize(old + std::max<ssize_t>(received, 0));
+			if (received < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return false;
+				throw_errno("recv");
+			}
+			if (received == 0)
+				throw std::runtime_error{"Connection closed before the end of the request"};
+			if (parse())
+				return true;
+		}
+	}
+
+	// Hands over the connection along with the request
+	std::pair<int, Request> take() { return {_connection.release(), std::move(_request)}; }
+
+	// Tells the client why its request was turned down, if it's listening. Never blocks.
+	void reject(std::string_view error) {
+		auto const frame = status_frame(1, error);
+		::send(fd(), frame.data(), frame.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+
+  private:
+	Descriptor _connection;
+	std::chrono::steady_clock::time_point _deadline;
+	// Received but not yet a whole frame
+	std::string _buffer{};
+	// Frame contents so far
+	std::size_t _size = 0;
+	Request _request{};
+
+	// Takes the whole frames off the front of the buffer, true once the end frame is one of them
+	bool parse() {
+		std::size_t at = 0;
+		bool ended = false;
+		while (!ended && _buffer.size() - at >= header_size) {
+			auto const size = frame_size(_buffer.data() + at);
+			if (size > max_request - _size)
+				throw RequestTooBig{};
+			if (_buffer.size() - at - header_size < size)
+				break;
+			auto const type = static_cast<Frame>(_buffer[at]);
+			std::string_view const data{_buffer.data() + at + header_size, size};
+			at += header_size + size;
+			_size += size;
+
+			auto &options = _request.options;
+			switch (type) {
+			case Frame::Program: _request.program = data; break;
+			case Frame::Seed: options.seed = get_u64(data, 0); break;
+			case Frame::Limits:
+				options.limits.fuel = get_u64(data, 0);
+				options.limits.stack = get_u64(data, 1);
+				options.limits.string_bytes = get_u64(data, 2);
+				options.limits.time = std::chrono::nanoseconds{get_u64(data, 3)};
+				break;
+			case Frame::Input: _request.input += data; break;
+			case Frame::End: ended = true; break;
+			case Frame::MemoStats:
+				_request.memo_stats = true;
+				ended = true;
+				break;
+			default: throw std::runtime_error{"Unexpected frame"};
+			}
+		}
+		_buffer.erase(0, at);
+		return ended;
+	}
+};
+
+void
+Server::serve() {
+	std::vector<std::unique_ptr<Incoming>> incoming{};
+	std::vector<pollfd> polled{};
+	while (!_stopping) {
+		polled.assign(1, pollfd{.fd = _socket, .events = POLLIN});
+		auto deadline = std::chrono::steady_clock::time_point::max();
+		for (auto const &client : incoming) {
+			polled.push_back(pollfd{.fd = client->fd(), .events = POLLIN});
+			deadline = std::min(deadline, client->deadline());
+		}
+		int timeout = -1;
+		if (!incoming.empty()) {
+			auto const left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+			timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(left.count(), 0));
+		}
+		if (::poll(polled.data(), polled.size(), timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			throw_errno("poll");
+		}
+		if (_stopping)
+			break;
+
+		auto const now = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < incoming.size(); ++i) {
+			auto &client = incoming[i];
+			try {
+				if (polled[i + 1].revents != 0 && client->read()) {
+					auto [fd, request] = client->take();
+					_pool.submit([this, fd, request = std::move(request)]() mutable {
+						handle(fd, std::move(request));
+					});
+					client.reset();
+				} else if (client->deadline() <= now) {
+					client->reject("Timed out waiting for the request");
+					client.reset();
+				}
+			} catch (RequestTooBig const &err) {
+				client->reject(err.what());
+				client.reset();
+			} catch (std::exception const &) {
+				// The client went away or sent garbage, there's no one to tell
+				client.reset();
+			}
+		}
+		std::erase(incoming, nullptr);
+
+		if (polled[0].revents & POLLIN) {
+			// Nonblocking, the client may have given up between poll() and here
+			auto const client = ::accept4(_socket, nullptr, nullptr, SOCK_CLOEXEC);
+			if (client >= 0) {
+				incoming.push_back(std::make_unique<Incoming>(client));
+			} else if (_stopping) {
+				break;
+			} else if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN && errno != EWOULDBLOCK) {
+				throw_errno("accept");
+			}
+		}
+	}
+}
+
+void
+Server::stop() {
+	_stopping = true;
+	// Wakes up poll()
+	::shutdown(_socket, SHUT_RDWR);
+}
+
+void
+Server::handle(int fd, Request request) {
+	Descriptor const connection{fd};
+	auto const client = connection.get();
+	try {
+		// A client that stops reading its output only holds the worker this long
+		timeval const timeout{.tv_sec = client_timeout.count()};
+		::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		if (request.memo_stats) {
+			std::string data{};
+			if (_memo) {
+				auto const stats = _memo->stats();
+				for (auto const value :
+				     {stats.hits, stats.disk_hits, stats.misses, stats.evictions, stats.disk_evictions,
+				      std::uint64_t{stats.entries}, std::uint64_t{stats.bytes}})
+					put_u64(data, value);
+			}
+			write_frame(client, Frame::MemoStats, data);
+			return;
+		}
+
+		auto &options = request.options;
+		auto &limits = options.limits;
+		limits.fuel = std::min(limits.fuel, _limits.fuel);
+		limits.stack = std::min(limits.stack, _limits.stack);
+		limits.string_bytes = std::min(limits.string_bytes, _limits.string_bytes);
+		limits.time = std::min(limits.time, _limits.time);
+		options.memo = _memo;
+
+		RunResult result{};
+		try {
+			auto const bytecode = _programs.get(request.program);
+			FrameBuffer buffer{client};
+			std::ostream output{&buffer};
+			result = run_memory(*bytecode, request.input, output, options);
+			output.flush();
+		} catch (std::runtime_error const &err) {
+			result = RunResult{.status = 1, .error = err.what()};
+		}
+
+		auto const status = status_frame(result.status, result.error);
+		send_all(client, status.data(), status.size());
+	} catch (std::exception const &) {
+		// The client went away, there's no one to tell
+	}
+}
+
+int
+run_remote(
+    std::filesystem::path const &socket, std::filesystem::path const &program, std::ostream &out, std::istream &in,
+    RunOptions const &options) {
+	try {
+		auto const connection = connect_to(socket);
+		auto const fd = connection.get();
+
+		write_frame(fd, Frame::Program, std::filesystem::absolute(program).native());
+		if (options.seed) {
+			std::string seed{};
+			put_u64(seed, *options.seed);
+			write_frame(fd, Frame::Seed, seed);
+		}
+		if (options.limits.any()) {
+			auto const &limits = options.limits;
+			std::string data{};
+			put_u64(data, limits.fuel);
+			put_u64(data, limits.stack);
+			put_u64(data, limits.string_bytes);
+			put_u64(data, limits.time.count());
+			write_frame(fd, Frame::Limits, data);
+		}
+		std::vector<char> chunk(chunk_size);
+		while (in.read(chunk.data(), chunk.size()) || in.gcount() > 0)
+			write_frame(fd, Frame::Input, {chunk.data(), static_cast<std::size_t>(in.gcount())});
+		write_frame(fd, Frame::End, {});
+
+		while (auto frame = read_frame(fd)) {
+			auto const &[type, data] = *frame;
+			if (type == Frame::Output) {
+				out.write(data.data(), data.size());
+			} else if (type == Frame::Status) {
+				auto const status = static_cast<int>(get_u64(data, 0));
+				if (data.size() > 8)
+					std::cerr << std::string_view{data}.substr(8) << std::endl;
+				return status;
+			}
+		}
+		throw std::runtime_error{"The server closed the connection without finishing the run"};
+	} catch (std::exception const &err) {
+		std::cerr << err.what() << std::endl;
+		return 1;
+	}
+}
+
+std::optional<ResultCache::Stats>
+remote_memo_stats(std::filesystem::path const &socket) {
+	auto const connection = connect_to(socket);
+	write_frame(connection.get(), Frame::MemoStats, {});
+	auto const frame = read_frame(connection.get());
+	if (!frame || frame->first != Frame::MemoStats)
+		throw std::runtime_error{"The server closed the connection without answering"};
+	auto const &data = frame->second;
+	if (data.empty())
+		return std::nullopt;
+	return ResultCache::Stats{
+	    .hits = get_u64(data, 0),
+	    .disk_hits = get_u64(data, 1),
+	    .misses = get_u64(data, 2),
+	    .evictions = get_u64(data, 3),
+	    .disk_evictions = get_u64(data, 4),
+	    .entries = get_u64(data, 5),
+	    .bytes = get_u64(data, 6)};
+}
+
+} // namespace nori
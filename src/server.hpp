@@ -0,0 +1,104 @@
+#pragma once
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "api.hpp"
+#include "result_cache.hpp"
+#include "thread_pool.hpp"
+
+namespace nori {
+
+// Compiled programs by path, compiled again whenever the file's modification time changes. Files ending in .nr are
+// taken as bytecode, anything else is compiled. Safe to share between threads.
+class ProgramCache {
+  public:
+	// Throws std::runtime_error if the file can't be read or doesn't compile
+	std::shared_ptr<std::string const> get(std::filesystem::path const &path);
+
+  private:
+	struct Entry {
+		std::filesystem::file_time_type modified;
+		std::shared_ptr<std::string const> bytecode;
+	};
+
+	std::mutex _mutex;
+	std::unordered_map<std::string, Entry> _entries;
+};
+
+// Runs programs for clients connecting over a Unix domain socket, so they don't pay for starting a process and
+// compiling each time.
+//
+// Each connection is one run. Both ways it's a series of frames, a type byte and a 32 bit little endian length
+// followed by that many bytes. The client sends the program's path, optionally a seed and limits, its input and an
+// end frame. The server answers with output frames as the program writes, and a status frame last holding the exit
+// status and the error message. A connection can instead send a single memo stats frame, answered by one holding the
+// server's ResultCache::Stats, or nothing if it isn't memoizing.
+//
+// Requests are read on the thread calling serve(), only complete ones go to the pool, so clients that connect and
+// send nothing can't hold up the runs. A client gets a few seconds to send its request, and a request can be at most
+// 64 MiB.
+class Server {
+  public:
+	// Listens on `socket`, replacing whatever was there. Runs are spread over `threads` threads, zero meaning one per
+	// hardware thread. Every run is held to `limits`, clients can only ask for lower ones. Results are reused through
+	// `memo` if it's set.
+	Server(
+	    std::filesystem::path socket, std::size_t threads = 0, vm::Limits const &limits = {},
+	    ResultCache *memo = nullptr);
+	Server(Server const &) = delete;
+	Server &operator=(Server const &) = delete;
+	// Finishes the runs in progress and removes the socket
+	~Server();
+
+	// Accepts connections until stop() is called
+	void serve();
+	// Can be called from any thread
+	void stop();
+
+  private:
+	std::filesystem::path _path;
+	vm::Limits const _limits;
+	ResultCache *const _memo;
+	int _socket;
+	std::atomic<bool> _stopping{false};
+	ProgramCache _programs{};
+	ThreadPool _pool;
+
+	struct Request {
+		std::filesystem::path program;
+		std::string input;
+		RunOptions options;
+		// Asks for the memo stats instead of a run
+		bool memo_stats = false;
+	};
+	// A connection whose request is still coming in
+	class Incoming;
+
+	void handle(int fd, Request request);
+};
+
+// Runs `program` on the server listening on `socket`, the same as run_stream would locally. The whole of `in` is
+// sent up front. Only the seed and limits in `options` are passed on.
+int
+run_remote(
+    std::filesystem::path const &socket, std::filesystem::path const &program, std::ostream &out = std::cout,
+    std::istream &in = std::cin, RunOptions const &options = {});
+
+// The memo stats of the server listening on `socket`, empty if it isn't memoizing. Throws std::runtime_error if the
+// server can't be reached.
+std::optional<ResultCache::Stats>
+remote_memo_stats(std::filesystem::path const &socket);
+
+} // namespace nori
+
+#endif
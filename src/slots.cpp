@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <bitset>
+#include <numeric>
+#include <utility>
+
+#include "slots.hpp"
+
+namespace nori {
+
+namespace {
+
+// Variables by id, the compiler allows at most 256
+using Live = std::bitset<256>;
+
+// What a stretch of nodes does to the variables live before it: gen | (live after & ~kill)
+struct Transfer {
+	Live gen{};
+	Live kill{};
+};
+
+bool
+is_store(parse::NodeType type) {
+	return type == parse::NodeType::SetVarPop || type == parse::NodeType::SetVarNumber ||
+	       type == parse::NodeType::SetVarString;
+}
+
+// Backwards liveness over the structured AST. A loop body can run any number of times, so what's live going into a
+// loop is what's live after it plus whatever the body reads before storing, and W goes back to the start with the
+// variables as they are.
+class Liveness {
+  public:
+	explicit Liveness(parse::Ast const &ast)
+	    : _ast{ast}, _dead(ast.nodes.size()), _interferes(ast.identifiers.size()), _uses(ast.identifiers.size()) {
+		// What's live at the start is live at every W, which depends on itself. It only grows, go round until it
+		// settles.
+		while (true) {
+			_loops.clear();
+			auto const start = summarize(0, _ast.nodes.size()).gen;
+			if (!_jumps_to_start || start == _start)
+				break;
+			_start = start;
+		}
+
+		// Every variable starts out as 0, the ones read before they're stored need that 0 to still be there
+		auto const entry = record(0, _ast.nodes.size(), Live{}, 0, 1);
+		for (std::size_t id = 0; id < _ast.identifiers.size(); ++id) {
+			if (entry.test(id))
+				_interferes[id] |= entry;
+		}
+
+		// Only the stored variable's side was noted, fill in the other
+		for (std::size_t id = 0; id < _ast.identifiers.size(); ++id) {
+			for (std::size_t other = 0; other < _ast.identifiers.size(); ++other) {
+				if (_interferes[id].test(other))
+					_interferes[other].set(id);
+			}
+		}
+	}
+
+	// Hands out slots hottest first, each taking the lowest one no variable it interferes with already has
+	SlotAllocation allocation() && {
+		auto const count = _ast.identifiers.size();
+		SlotAllocation result{.slots = std::vector(count, SlotAllocation::no_slot), .dead = std::move(_dead)};
+
+		std::vector<std::size_t> order(count);
+		std::iota(order.begin(), order.end(), 0);
+		std::erase_if(order, [&](auto id) { return _uses[id] == 0; });
+		std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) { return _uses[a] > _uses[b]; });
+
+		for (auto const id : order) {
+			Live taken{};
+			for (std::size_t other = 0; other < count; ++other) {
+				if (_interferes[id].test(other) && result.slots[other] != SlotAllocation::no_slot)
+					taken.set(result.slots[other]);
+			}
+			std::uint16_t slot = 0;
+			while (taken.test(slot))
+				++slot;
+			result.slots[id] = slot;
+			result.count = std::max<std::size_t>(result.count, slot + 1);
+		}
+		return result;
+	}
+
+  private:
+	parse::Ast const &_ast;
+	Live _start{};
+	bool _jumps_to_start = false;
+	// Loops in the order they appear
+	struct Loop {
+		// What the body reads before storing
+		Live gen{};
+		// Index of the first loop after this one and the loops in its body
+		std::size_t next = 0;
+	};
+	std::vector<Loop> _loops{};
+	std::vector<bool> _dead;
+	std::vector<Live> _interferes;
+	// Uses weighted by loop depth
+	std::vector<double> _uses;
+	// ConditionalNode indexes with their index in _loops, for record()
+	std::vector<std::pair<std::size_t, std::size_t>> _nested{};
+
+	// Summary of [begin, end), noting what each loop in it reads before storing
+	Transfer summarize(std::size_t begin, std::size_t end) {
+		Transfer range{};
+		for (auto i = begin; i < end;) {
+			auto const &node = _ast.nodes[i];
+			if (node.type == parse::NodeType::ConditionalNode) {
+				// The body might not run, so nothing it stores can be counted on
+				auto const loop = _loops.size();
+				_loops.emplace_back();
+				auto const body = _loops[loop].gen = summarize(i + 1, node.arg).gen;
+				_loops[loop].next = _loops.size();
+				range.gen |= body & ~range.kill;
+				i = node.arg;
+				continue;
+			}
+
+			if (node.type == parse::NodeType::PushVar) {
+				if (!range.kill.test(node.arg))
+					range.gen.set(node.arg);
+			} else if (is_store(node.type)) {
+				range.kill.set(node.arg);
+			} else if (node.type == parse::NodeType::JumpBeginNode) {
+				range.gen |= _start & ~range.kill;
+				range.kill.set();
+				_jumps_to_start = true;
+			}
+			++i;
+		}
+		return range;
+	}
+
+	// Walks [begin, end) backwards from what's live after it, marking dead stores, counting uses and noting which
+	// variables are live while another is stored. `loop` is the index of the first loop in the range. Returns what's
+	// live before it.
+	Live record(std::size_t begin, std::size_t end, Live live, std::size_t loop, double weight) {
+		// The loops directly in the range, nested ranges push theirs after them and take them off again. Everything
+		// between them is straight line.
+		auto const first = _nested.size();
+		for (auto i = begin; i < end;) {
+			auto const &node = _ast.nodes[i];
+			if (node.type == parse::NodeType::ConditionalNode) {
+				_nested.emplace_back(i, loop);
+				loop = _loops[loop].next;
+				i = node.arg;
+			} else {
+				++i;
+			}
+		}
+
+		for (auto at = _nested.size(); at-- > first;) {
+			auto const [index, inner] = _nested[at];
+			straight(_ast.nodes[index].arg, end, live, weight);
+			live |= _loops[inner].gen;
+			record(index + 1, _ast.nodes[index].arg, live, inner + 1, std::min(weight * 8, 1e15));
+			end = index;
+		}
+		straight(begin, end, live, weight);
+		_nested.resize(first);
+		return live;
+	}
+
+	// record() for a range with no loops in it
+	void straight(std::size_t begin, std::size_t end, Live &live, double weight) {
+		for (auto index = end; index-- > begin;) {
+			auto const &node = _ast.nodes[index];
+			if (node.type == parse::NodeType::PushVar) {
+				_uses[node.arg] += weight;
+				live.set(node.arg);
+			} else if (is_store(node.type)) {
+				if (!live.test(node.arg)) {
+					_dead[index] = true;
+					continue;
+				}
+				_uses[node.arg] += weight;
+				live.reset(node.arg);
+				_interferes[node.arg] |= live;
+			} else if (node.type == parse::NodeType::JumpBeginNode) {
+				live = _start;
+			}
+		}
+	}
+};
+
+} // namespace
+
+SlotAllocation
+identity_slots(parse::Ast const &ast) {
+	SlotAllocation result{.slots = std::vector<std::uint16_t>(ast.identifiers.size()), .count = ast.identifiers.size()};
+	std::iota(result.slots.begin(), result.slots.end(), 0);
+	return result;
+}
+
+SlotAllocation
+allocate_slots(parse::Ast const &ast) {
+	return Liveness{ast}.allocation();
+}
+
+} // namespace nori
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef SLOTS_HPP
+#define SLOTS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "parse/node.hpp"
+
+namespace nori {
+
+// Where the compiler puts each variable
+struct SlotAllocation {
+	static constexpr std::uint16_t no_slot = 0xffff;
+
+	// Slot for each identifier id, no_slot for the ones nothing needs
+	std::vector<std::uint16_t> slots;
+	// How many slots there are, the bytecode header holds this
+	std::size_t count = 0;
+	// By node index, true for stores whose value is never read. Empty if there aren't any.
+	std::vector<bool> dead;
+
+	bool is_dead(std::size_t node) const { return node < dead.size() && dead[node]; }
+};
+
+// One slot per identifier, numbered by id, for pieces compiled separately that have to agree on where variables are
+SlotAllocation
+identity_slots(parse::Ast const &ast);
+
+// Works out where each variable's value can still be read, to drop stores that never are and let variables that are
+// never needed at the same time share a slot. Slots are numbered by how often they're used, uses inside loops counting
+// for more, so the hottest variables sit together at the front.
+SlotAllocation
+allocate_slots(parse::Ast const &ast);
+
+} // namespace nori
+
+#endif
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <utility>
+
+#include "thread_pool.hpp"
+
+namespace nori {
+
+namespace {
+
+thread_local ThreadPool const *current_pool = nullptr;
+thread_local std::size_t current_index = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(std::size_t threads) : _next_queue{0}, _queued{0}, _unfinished{0}, _stopping{false} {
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (std::size_t i = 0; i < threads; ++i)
+		_queues.emplace_back(std::make_unique<Queue>());
+	for (std::size_t i = 0; i < threads; ++i)
+		_threads.emplace_back([this, i] { work(i); });
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+	{
+		std::lock_guard const lock{_mutex};
+		_stopping = true;
+	}
+	_work_available.notify_all();
+	for (auto &thread : _threads)
+		thread.join();
+}
+
+void
+ThreadPool::submit(std::function<void()> task) {
+	std::size_t const index =
+	    current_pool == this ? current_index : _next_queue.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+
+	_unfinished.fetch_add(1);
+	{
+		std::lock_guard const lock{_queues[index]->mutex};
+		_queues[index]->tasks.emplace_back(std::move(task));
+	}
+	_queued.fetch_add(1);
+
+	// Taking the lock makes sure a worker can't miss the notification between checking for work and going to sleep
+	{ std::lock_guard const lock{_mutex}; }
+	_work_available.notify_one();
+}
+
+void
+ThreadPool::wait() {
+	std::unique_lock lock{_mutex};
+	_all_finished.wait(lock, [this] { return _unfinished.load() == 0; });
+}
+
+bool
+ThreadPool::try_run(std::size_t index) {
+	std::function<void()> task;
+
+	for (std::size_t i = 0; i < _queues.size() && !task; ++i) {
+		auto &queue = *_queues[(index + i) % _queues.size()];
+		std::lock_guard const lock{queue.mutex};
+		if (queue.tasks.empty())
+			continue;
+		// Own queue from the back, others from the front
+		if (i == 0) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+	}
+
+	if (!task)
+		return false;
+
+	_queued.fetch_sub(1);
+	task();
+	if (_unfinished.fetch_sub(1) == 1) {
+		{ std::lock_guard const lock{_mutex}; }
+		_all_finished.notify_all();
+	}
+	return true;
+}
+
+void
+ThreadPool::work(std::size_t index) {
+	current_pool = this;
+	current_index = index;
+
+	while (true) {
+		if (try_run(index))
+			continue;
+
+		std::unique_lock lock{_mutex};
+		_work_available.wait(lock, [this] { return _queued.load() > 0 || _stopping; });
+		if (_stopping && _queued.load() == 0)
+			return;
+	}
+}
+
+} // namespace nori
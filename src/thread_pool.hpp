@@ -0,0 +1,60 @@
+#pragma once
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nori {
+
+// Work stealing thread pool.
+//
+// Every worker has its own queue. Workers take tasks from the back of their own queue and steal from the front of
+// the others' once it runs dry. Tasks submitted from outside the pool are spread round robin, tasks submitted from a
+// worker go onto that worker's queue.
+class ThreadPool {
+  public:
+	// Zero threads means one per hardware thread
+	explicit ThreadPool(std::size_t threads = 0);
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+	// Finishes every submitted task before returning
+	~ThreadPool();
+
+	void submit(std::function<void()> task);
+
+	// Blocks until every task submitted so far has finished
+	void wait();
+
+	std::size_t size() const { return _threads.size(); }
+
+  private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> _queues;
+	std::vector<std::thread> _threads;
+	std::atomic<std::size_t> _next_queue;
+	std::atomic<std::size_t> _queued;
+	std::atomic<std::size_t> _unfinished;
+	std::mutex _mutex;
+	std::condition_variable _work_available;
+	std::condition_variable _all_finished;
+	bool _stopping;
+
+	void work(std::size_t index);
+	bool try_run(std::size_t index);
+};
+
+} // namespace nori
+
+#endif
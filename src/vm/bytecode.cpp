@@ -0,0 +1,66 @@
+#include "bytecode.hpp"
+
+namespace nori::vm {
+
+Instruction
+decode_at(std::string_view bytecode, std::size_t pos) {
+	Instruction ins{.offset = pos, .op = static_cast<std::uint8_t>(bytecode[pos])};
+	switch (ins.op) {
+	case Op::Push: ins.size = 9; break;
+	case Op::PushString: {
+		auto const end = bytecode.find('\0', pos + 1);
+		ins.size = (end == std::string_view::npos ? bytecode.size() : end + 1) - pos;
+		break;
+	}
+	case Op::PushVar:
+	case Op::SetVarPop:
+	case Op::ForwardJumpFalse:
+	case Op::BackwardJumpTrue:
+	case Op::Map:
+		ins.size = 2;
+		if (pos + 1 < bytecode.size())
+			ins.arg = static_cast<std::uint8_t>(bytecode[pos + 1]);
+		break;
+	default: break;
+	}
+	return ins;
+}
+
+std::vector<Instruction>
+decode(std::string_view bytecode) {
+	std::vector<Instruction> instructions{};
+	// The first byte is the variable count
+	std::size_t pos = 1;
+	while (pos < bytecode.size()) {
+		auto const ins = decode_at(bytecode, pos);
+		if (ins.op >= OpCount)
+			break;
+		instructions.emplace_back(ins);
+		pos += ins.size;
+	}
+	return instructions;
+}
+
+bool
+is_deterministic(std::string_view bytecode) {
+	std::size_t pos = 1;
+	while (pos < bytecode.size()) {
+		auto const ins = decode_at(bytecode, pos);
+		if (ins.op >= OpCount || ins.op == Op::Rand || ins.op == Op::BitRand || ins.op == Op::ByteRand)
+			return false;
+		pos += ins.size;
+	}
+	return pos == bytecode.size();
+}
+
+std::vector<Loop>
+loops(std::vector<Instruction> const &instructions) {
+	std::vector<Loop> result{};
+	for (auto const &ins : instructions) {
+		if (ins.op == Op::ForwardJumpFalse)
+			result.emplace_back(Loop{.begin = ins.offset, .end = ins.offset + ins.size + ins.arg});
+	}
+	return result;
+}
+
+} // namespace nori::vm
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "op.hpp"
+
+namespace nori::vm {
+
+// One decoded instruction. Offsets count from the start of the bytecode, header included, the same as the VM's.
+struct Instruction {
+	std::size_t offset;
+	std::uint8_t op;
+	// Variable slot for PushVar and SetVarPop, jump distance for ForwardJumpFalse and BackwardJumpTrue
+	std::uint8_t arg = 0;
+	// Size in bytes, operands included
+	std::size_t size = 1;
+};
+
+// A [ ... ] loop, from its ForwardJumpFalse up to one past its BackwardJumpTrue
+struct Loop {
+	std::size_t begin;
+	std::size_t end;
+};
+
+// The instruction at `pos`, which has to be inside the bytecode. Unknown opcodes come back as one byte instructions.
+Instruction
+decode_at(std::string_view bytecode, std::size_t pos);
+
+// Splits bytecode into instructions, stopping at the end or at the first byte that isn't an opcode
+std::vector<Instruction>
+decode(std::string_view bytecode);
+
+// Whether the bytecode decodes cleanly and has none of r, b and B, so what it does depends only on its input
+bool
+is_deterministic(std::string_view bytecode);
+
+// Loops found by matching up the jumps, in order of their start, so outer loops come before the ones they contain
+std::vector<Loop>
+loops(std::vector<Instruction> const &instructions);
+
+} // namespace nori::vm
+
+#endif
@@ -0,0 +1,24 @@
+#include <fmt/format.h>
+
+#include "error.hpp"
+
+namespace nori::vm {
+
+std::string
+error_message(Error const &error) {
+	if (error.kind == ErrorKind::UnhandledOpcode)
+		return fmt::format("Unhandled opcode {} at {}", error.op, error.pos);
+
+	switch (error.kind) {
+	case ErrorKind::None: return "";
+
+#define X(Name, Message) \
+	case ErrorKind::Name: return Message;
+
+		XERRORS
+#undef X
+	}
+	return "";
+}
+
+} // namespace nori::vm
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef ERROR_HPP
+#define ERROR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nori::vm {
+
+// Ways a run can fail, with their messages. The limit ones are last, see is_limit().
+#define XERRORS \
+	X(StackUnderflow, "Stack doesn't contain enough elements") \
+	X(InvalidOperand, "Attempted to operate on two invalid operands") \
+	X(AsciiOutOnString, "Ascii out on string") \
+	X(UnhandledOpcode, "Unhandled opcode") \
+	X(RangeTooLarge, "Range too large") \
+	X(InstructionLimit, "Instruction limit exceeded") \
+	X(TimeLimit, "Time limit exceeded") \
+	X(StackLimit, "Stack limit exceeded") \
+	X(StringLimit, "String memory limit exceeded")
+
+#define X(Name, _) Name,
+
+enum class ErrorKind : std::uint8_t {
+	None,
+	XERRORS
+};
+
+#undef X
+
+inline constexpr bool
+is_limit(ErrorKind kind) {
+	return kind >= ErrorKind::InstructionLimit;
+}
+
+// Why a run failed, returned by the VM instead of thrown so a failing run costs no more than one that finishes
+struct Error {
+	ErrorKind kind = ErrorKind::None;
+	// Bytecode offset of the instruction that failed. Limits are noticed before the next instruction runs, so for
+	// those it's where the run stopped.
+	std::size_t pos = 0;
+	// The opcode at `pos`
+	std::uint8_t op = 0;
+
+	explicit operator bool() const { return kind != ErrorKind::None; }
+};
+
+// The message run_stream prints for `error`
+std::string
+error_message(Error const &error);
+
+} // namespace nori::vm
+
+#endif
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+#include "input.hpp"
+
+namespace nori::vm {
+
+namespace {
+
+bool
+is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+bool
+is_number_char(char c) {
+	return ('0' <= c && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-';
+}
+
+} // namespace
+
+InputReader::InputReader()
+    : _stream{nullptr}, _buffer(block_size), _begin{0}, _end{0}, _eof{true}, _failed{false}, _starved{false},
+      _log{nullptr}, _logged{0} {}
+
+InputReader::InputReader(std::istream &stream) : InputReader{} { reset(stream); }
+
+void
+InputReader::reset(std::istream &stream) {
+	_stream = &stream;
+	_begin = 0;
+	_end = 0;
+	_eof = false;
+	_failed = false;
+	_starved = false;
+	_log = nullptr;
+	_logged = 0;
+}
+
+void
+InputReader::reset() {
+	_stream = nullptr;
+	_begin = 0;
+	_end = 0;
+	_eof = false;
+	_failed = false;
+	_starved = false;
+	_log = nullptr;
+	_logged = 0;
+}
+
+void
+InputReader::feed(std::string_view data) {
+	compact();
+	if (_buffer.size() - _end < data.size())
+		_buffer.resize(std::max(_buffer.size() * 2, _end + data.size()));
+	std::copy(data.begin(), data.end(), _buffer.begin() + _end);
+	_end += data.size();
+	_starved = false;
+}
+
+void
+InputReader::restore(std::string_view pending, bool failed) {
+	feed(pending);
+	_failed = failed;
+}
+
+void
+InputReader::close() {
+	_eof = true;
+	_starved = false;
+}
+
+void
+InputReader::record(std::string *log) {
+	_log = log;
+	_logged = _begin;
+}
+
+void
+InputReader::log_consumed() {
+	if (_log)
+		_log->append(_buffer.data() + _logged, _buffer.data() + _begin);
+	_logged = _begin;
+}
+
+void
+InputReader::compact() {
+	// Anything consumed is about to be moved out of the way
+	log_consumed();
+	if (_begin > 0) {
+		std::copy(_buffer.begin() + _begin, _buffer.begin() + _end, _buffer.begin());
+		_end -= _begin;
+		_begin = 0;
+		_logged = 0;
+	}
+}
+
+bool
+InputReader::fill() {
+	if (_eof)
+		return false;
+	if (!_stream) {
+		_starved = true;
+		return false;
+	}
+
+	// Formatted reads would flush the tied stream (prompts written to cout), so do the same
+	if (auto const tied = _stream->tie())
+		tied->flush();
+
+	compact();
+	if (_end == _buffer.size())
+		_buffer.resize(_buffer.size() * 2);
+
+	auto *const buf = _stream->rdbuf();
+	// sgetc blocks until at least one character is available, everything past that has to already be buffered so
+	// interactive input doesn't hang waiting for a full block
+	if (buf == nullptr || std::istream::traits_type::eq_int_type(buf->sgetc(), std::istream::traits_type::eof())) {
+		_eof = true;
+		return false;
+	}
+	std::streamsize const space = _buffer.size() - _end;
+	std::streamsize const available = std::clamp<std::streamsize>(buf->in_avail(), 1, space);
+	_end += buf->sgetn(_buffer.data() + _end, available);
+	return true;
+}
+
+bool
+InputReader::skip_whitespace() {
+	while (true) {
+		while (_begin != _end && is_space(_buffer[_begin]))
+			++_begin;
+		if (_begin != _end)
+			return true;
+		if (!fill())
+			return false;
+	}
+}
+
+std::optional<double>
+InputReader::read_number() {
+	if (_failed)
+		return std::nullopt;
+	if (!skip_whitespace()) {
+		_failed = !_starved;
+		log_consumed();
+		return std::nullopt;
+	}
+
+	// Make sure the whole number is buffered before parsing it
+	std::size_t len = 0;
+	while (true) {
+		while (_begin + len != _end && is_number_char(_buffer[_begin + len]))
+			++len;
+		if (_begin + len != _end || !fill())
+			break;
+	}
+	if (_starved)
+		return std::nullopt;
+
+	char const *first = _buffer.data() + _begin;
+	char const *const last = first + len;
+	// from_chars doesn't take a leading '+'
+	if (first != last && *first == '+' && (first + 1 == last || first[1] != '-'))
+		++first;
+
+	double res;
+	auto const [ptr, ec] = std::from_chars(first, last, res);
+	if (ec != std::errc{}) {
+		_failed = true;
+		log_consumed();
+		return std::nullopt;
+	}
+	_begin = ptr - _buffer.data();
+	log_consumed();
+	return res;
+}
+
+std::string_view
+InputReader::read_line() {
+	if (_failed)
+		return {};
+
+	std::size_t searched = 0;
+	while (true) {
+		auto const *const begin = _buffer.data() + _begin;
+		auto const *const newline =
+		    static_cast<char const *>(std::memchr(begin + searched, '\n', _end - _begin - searched));
+		if (newline != nullptr) {
+			std::string_view const line{begin, newline};
+			_begin += line.size() + 1;
+			log_consumed();
+			return line;
+		}
+		searched = _end - _begin;
+		if (!fill())
+			break;
+	}
+
+	if (_starved)
+		return {};
+	if (_begin == _end) {
+		_failed = true;
+		return {};
+	}
+	std::string_view const line{_buffer.data() + _begin, _end - _begin};
+	_begin = _end;
+	log_consumed();
+	return line;
+}
+
+int
+InputReader::read_char() {
+	if (_failed)
+		return std::istream::traits_type::eof();
+	if (_begin == _end && !fill()) {
+		_failed = !_starved;
+		return std::istream::traits_type::eof();
+	}
+	auto const c = std::istream::traits_type::to_int_type(_buffer[_begin++]);
+	if (_log)
+		_log->push_back(static_cast<char>(c));
+	_logged = _begin;
+	return c;
+}
+
+} // namespace nori::vm
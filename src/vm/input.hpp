@@ -0,0 +1,82 @@
+#pragma once
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nori::vm {
+
+// Buffered reader for the VM's input ops.
+//
+// Pulls whatever the underlying stream buffer has available in one go instead of going through the formatted,
+// locale-aware istream operators. Reads ahead, so the stream shouldn't be used by anything else while the reader is
+// alive.
+//
+// Failure is sticky, like the stream's failbit: once an op fails, every later op fails too.
+//
+// Without a stream the reader is fed by hand instead. When an op runs out of fed input before input is closed it
+// consumes nothing and sets starved(), so it can be retried once there's more.
+class InputReader {
+  public:
+	static constexpr std::size_t block_size = 64 * 1024;
+
+	InputReader();
+	InputReader(std::istream &stream);
+
+	// Switches to a new stream, dropping anything buffered from the old one but keeping the buffer. Stops recording.
+	void reset(std::istream &stream);
+	// The same, but the input is given through feed()
+	void reset();
+
+	// Adds input after a reset() without a stream
+	void feed(std::string_view data);
+	// Marks the end of fed input, after which ops fail at the end the same as at the end of a stream
+	void close();
+	// Whether the last op stopped because it needs more fed input
+	bool starved() const { return _starved; }
+
+	// Input that's been read in but not consumed yet
+	std::string_view pending() const { return {_buffer.data() + _begin, _end - _begin}; }
+	bool failed() const { return _failed; }
+	// Puts back what pending() and failed() gave, after a reset(), ahead of anything still to come
+	void restore(std::string_view pending, bool failed);
+
+	// Appends every byte the ops consume to `log`, until the next reset(). Bytes read ahead aren't included, so
+	// feeding the log back in as input makes the same ops return the same results.
+	void record(std::string *log);
+
+	// Equivalent of `stream >> double`
+	std::optional<double> read_number();
+
+	// Equivalent of std::getline. The view is only valid until the next read.
+	std::string_view read_line();
+
+	// Equivalent of stream.get()
+	int read_char();
+
+  private:
+	std::istream *_stream;
+	std::vector<char> _buffer;
+	std::size_t _begin;
+	std::size_t _end;
+	bool _eof;
+	bool _failed;
+	bool _starved;
+	std::string *_log;
+	// Where the bytes that haven't been added to the log yet start
+	std::size_t _logged;
+
+	bool fill();
+	bool skip_whitespace();
+	void log_consumed();
+	void compact();
+};
+
+} // namespace nori::vm
+
+#endif
@@ -0,0 +1,156 @@
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "kernels.hpp"
+#include "vm.hpp"
+
+namespace nori::vm {
+
+namespace {
+
+// Four doubles, in whatever registers the target has
+struct Block {
+#if defined(__AVX2__)
+	__m256d v;
+
+	static Block load(double const *p) { return {_mm256_loadu_pd(p)}; }
+	static Block splat(double x) { return {_mm256_set1_pd(x)}; }
+	void store(double *p) const { _mm256_storeu_pd(p, v); }
+
+	friend Block operator+(Block a, Block b) { return {_mm256_add_pd(a.v, b.v)}; }
+	friend Block operator-(Block a, Block b) { return {_mm256_sub_pd(a.v, b.v)}; }
+	friend Block operator*(Block a, Block b) { return {_mm256_mul_pd(a.v, b.v)}; }
+	friend Block operator/(Block a, Block b) { return {_mm256_div_pd(a.v, b.v)}; }
+	// b where either is NaN, the same as the scalar versions below
+	friend Block min(Block a, Block b) { return {_mm256_min_pd(a.v, b.v)}; }
+	friend Block max(Block a, Block b) { return {_mm256_max_pd(a.v, b.v)}; }
+#elif defined(__SSE2__)
+	__m128d lo;
+	__m128d hi;
+
+	static Block load(double const *p) { return {_mm_loadu_pd(p), _mm_loadu_pd(p + 2)}; }
+	static Block splat(double x) { return {_mm_set1_pd(x), _mm_set1_pd(x)}; }
+	void store(double *p) const {
+		_mm_storeu_pd(p, lo);
+		_mm_storeu_pd(p + 2, hi);
+	}
+
+	friend Block operator+(Block a, Block b) { return {_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)}; }
+	friend Block operator-(Block a, Block b) { return {_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)}; }
+	friend Block operator*(Block a, Block b) { return {_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)}; }
+	friend Block operator/(Block a, Block b) { return {_mm_div_pd(a.lo, b.lo), _mm_div_pd(a.hi, b.hi)}; }
+	friend Block min(Block a, Block b) { return {_mm_min_pd(a.lo, b.lo), _mm_min_pd(a.hi, b.hi)}; }
+	friend Block max(Block a, Block b) { return {_mm_max_pd(a.lo, b.lo), _mm_max_pd(a.hi, b.hi)}; }
+#else
+	std::array<double, 4> v;
+
+	static Block load(double const *p) { return {{p[0], p[1], p[2], p[3]}}; }
+	static Block splat(double x) { return {{x, x, x, x}}; }
+	void store(double *p) const { std::copy(v.begin(), v.end(), p); }
+
+	template <class F>
+	static Block each(Block a, Block b, F f) {
+		return {{f(a.v[0], b.v[0]), f(a.v[1], b.v[1]), f(a.v[2], b.v[2]), f(a.v[3], b.v[3])}};
+	}
+	friend Block operator+(Block a, Block b) { return each(a, b, [](double x, double y) { return x + y; }); }
+	friend Block operator-(Block a, Block b) { return each(a, b, [](double x, double y) { return x - y; }); }
+	friend Block operator*(Block a, Block b) { return each(a, b, [](double x, double y) { return x * y; }); }
+	friend Block operator/(Block a, Block b) { return each(a, b, [](double x, double y) { return x / y; }); }
+	friend Block min(Block a, Block b) { return each(a, b, [](double x, double y) { return x < y ? x : y; }); }
+	friend Block max(Block a, Block b) { return each(a, b, [](double x, double y) { return x > y ? x : y; }); }
+#endif
+};
+
+constexpr std::size_t block_size = 4;
+
+double
+min(double a, double b) {
+	return a < b ? a : b;
+}
+
+double
+max(double a, double b) {
+	return a > b ? a : b;
+}
+
+// `f` has to work on both Blocks and doubles
+template <class F>
+double
+reduce(std::span<double const> values, double identity, F f) {
+	auto acc = Block::splat(identity);
+	std::size_t i = 0;
+	for (; i + block_size <= values.size(); i += block_size)
+		acc = f(acc, Block::load(values.data() + i));
+
+	std::array<double, block_size> partials;
+	acc.store(partials.data());
+	auto result = f(f(partials[0], partials[1]), f(partials[2], partials[3]));
+	for (; i < values.size(); ++i)
+		result = f(result, values[i]);
+	return result;
+}
+
+template <class F>
+void
+map(std::span<double> values, double operand, F f) {
+	auto const constant = Block::splat(operand);
+	std::size_t i = 0;
+	for (; i + block_size <= values.size(); i += block_size)
+		f(Block::load(values.data() + i), constant).store(values.data() + i);
+	for (; i < values.size(); ++i)
+		values[i] = f(values[i], operand);
+}
+
+} // namespace
+
+double
+sum(std::span<double const> values) {
+	return reduce(values, 0.0, [](auto a, auto b) { return a + b; });
+}
+
+double
+product(std::span<double const> values) {
+	return reduce(values, 1.0, [](auto a, auto b) { return a * b; });
+}
+
+double
+min(std::span<double const> values) {
+	// Starting every partial at the first value leaves the result alone
+	return reduce(values, values.front(), [](auto a, auto b) { return min(a, b); });
+}
+
+double
+max(std::span<double const> values) {
+	return reduce(values, values.front(), [](auto a, auto b) { return max(a, b); });
+}
+
+bool
+apply(std::span<double> values, std::uint8_t op, double operand) {
+	switch (op) {
+	case Op::Add: map(values, operand, [](auto a, auto b) { return a + b; }); return true;
+	case Op::Sub: map(values, operand, [](auto a, auto b) { return a - b; }); return true;
+	case Op::Mul: map(values, operand, [](auto a, auto b) { return a * b; }); return true;
+	case Op::Div: map(values, operand, [](auto a, auto b) { return a / b; }); return true;
+	default: break;
+	}
+
+	// The rest have no vector instructions, they run through the VM's own definitions
+	switch (op) {
+#define X(OpCode, Fn) \
+	case OpCode: \
+		for (auto &value : values) \
+			value = (Fn)(value, operand); \
+		return true;
+
+		XBINOPS
+#undef X
+	default: return false;
+	}
+}
+
+} // namespace nori::vm
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <cstdint>
+#include <span>
+
+namespace nori::vm {
+
+// Loops behind the bulk stack ops, over numbers laid out one after another. Vectorised when the target has SSE2 or
+// AVX2.
+//
+// The reductions always keep four partial results, element i going into partial i % 4, and combine them as
+// (0 op 1) op (2 op 3) before folding in the tail. Rounding then comes out the same whichever way the build was
+// vectorised, though it can differ from a loop of + or * in the program.
+
+double
+sum(std::span<double const> values);
+
+double
+product(std::span<double const> values);
+
+// `values` can't be empty
+double
+min(std::span<double const> values);
+
+double
+max(std::span<double const> values);
+
+// Sets every value to `value op operand`, for any of the ops in XBINOPS. Returns false for any other op.
+bool
+apply(std::span<double> values, std::uint8_t op, double operand);
+
+} // namespace nori::vm
+
+#endif
@@ -0,0 +1,137 @@
+#pragma once
+#ifndef LIMITS_HPP
+#define LIMITS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <variant>
+
+#include "../common.hpp"
+#include "error.hpp"
+#include "observer.hpp"
+
+namespace nori::vm {
+
+// Caps on what one run can use, each unlimited by default
+struct Limits {
+	static constexpr std::uint64_t unlimited = std::numeric_limits<std::uint64_t>::max();
+
+	// Instructions, counted in bytes of bytecode gone back over by loops and W (see Limiter)
+	std::uint64_t fuel = unlimited;
+	// Values on the stack
+	std::uint64_t stack = unlimited;
+	// Bytes of string data on the stack
+	std::uint64_t string_bytes = unlimited;
+	// Wall time, only checked while the program is looping, so time spent waiting for input isn't caught
+	std::chrono::nanoseconds time = std::chrono::nanoseconds::max();
+
+	bool any() const {
+		return fuel != unlimited || stack != unlimited || string_bytes != unlimited ||
+		       time != std::chrono::nanoseconds::max();
+	}
+};
+
+// Observer enforcing Limits, passing every hook on to another observer as well.
+//
+// Fuel is only charged when a loop goes round or W starts over, by the distance jumped back plus one. Code in between
+// runs straight through, so a program runs at most its own size in instructions more than it was charged for, and
+// there's nothing to do on every other instruction. Time is checked every few thousand charges.
+//
+// Going over a limit sets failure(), which the VM checks before each instruction and fails the run with.
+template <Observer O = NullObserver>
+class Limiter {
+  public:
+	Limiter() = default;
+	Limiter(Limits const &limits, O *inner = nullptr)
+	    : _inner{inner}, _fuel{limits.fuel}, _stack{limits.stack}, _string_bytes_limit{limits.string_bytes},
+	      _deadline{
+	          limits.time == std::chrono::nanoseconds::max()
+	              ? std::chrono::steady_clock::time_point::max()
+	              : std::chrono::steady_clock::now() + limits.time} {}
+
+	void instruction(std::uint8_t op, std::size_t pos) {
+		if constexpr (forwards)
+			_inner->instruction(op, pos);
+	}
+
+	void jump(std::size_t from, std::size_t to, bool taken) {
+		if constexpr (forwards)
+			_inner->jump(from, to, taken);
+		if (!taken || to > from)
+			return;
+		auto const charge = from - to + 1;
+		if (charge > _fuel) {
+			_failure = ErrorKind::InstructionLimit;
+			return;
+		}
+		_fuel -= charge;
+		if (--_until_clock == 0) {
+			_until_clock = clock_interval;
+			if (std::chrono::steady_clock::now() > _deadline)
+				_failure = ErrorKind::TimeLimit;
+		}
+	}
+
+	void pushed(NoriValue const &value, std::size_t depth) {
+		if constexpr (forwards && requires { _inner->pushed(value, depth); })
+			_inner->pushed(value, depth);
+		if (depth > _stack)
+			_failure = ErrorKind::StackLimit;
+		if (auto const *str = std::get_if<std::string>(&value)) {
+			_string_bytes += str->size();
+			if (_string_bytes > _string_bytes_limit)
+				_failure = ErrorKind::StringLimit;
+		}
+	}
+
+	void popped(NoriValue const &value) {
+		if constexpr (forwards && requires { _inner->popped(value); })
+			_inner->popped(value);
+		if (auto const *str = std::get_if<std::string>(&value))
+			_string_bytes -= str->size();
+	}
+
+	ErrorKind failure() const { return _failure; }
+
+	// Starts over with a fresh budget, still counting the strings already on the stack
+	void renew(Limits const &limits) {
+		auto const string_bytes = _string_bytes;
+		*this = Limiter{limits, _inner};
+		_string_bytes = string_bytes;
+	}
+
+	void loaded(std::size_t bytes)
+		requires requires(O inner) { inner.loaded(std::size_t{}); }
+	{
+		_inner->loaded(bytes);
+	}
+
+	void variables_grown(std::size_t count)
+		requires requires(O inner) { inner.variables_grown(std::size_t{}); }
+	{
+		_inner->variables_grown(count);
+	}
+
+  private:
+	static constexpr bool forwards = !std::is_same_v<O, NullObserver>;
+	static constexpr std::uint32_t clock_interval = 4096;
+
+	O *_inner = nullptr;
+	std::uint64_t _fuel = Limits::unlimited;
+	std::uint64_t _stack = Limits::unlimited;
+	std::uint64_t _string_bytes_limit = Limits::unlimited;
+	std::uint64_t _string_bytes = 0;
+	std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::time_point::max();
+	std::uint32_t _until_clock = clock_interval;
+	ErrorKind _failure = ErrorKind::None;
+};
+
+static_assert(Observer<Limiter<>>);
+
+} // namespace nori::vm
+
+#endif
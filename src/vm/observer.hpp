@@ -0,0 +1,36 @@
+#pragma once
+#ifndef OBSERVER_HPP
+#define OBSERVER_HPP
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+namespace nori::vm {
+
+// Watches a VM run. The hooks are called from the VM's dispatch loop, so they have to be cheap, and with NullObserver
+// they compile away entirely.
+//
+// Observers can also have any of these, which the VM only calls if they exist:
+//   pushed(NoriValue const &value, std::size_t depth)  after a value goes on the stack, with the new stack depth
+//   popped(NoriValue const &value)                     before a value comes off the stack
+//   loaded(std::size_t bytes)                          after a block of bytecode is read into the buffer
+//   variables_grown(std::size_t count)                 after the variable array grows
+template <class O>
+concept Observer = requires(O observer, std::uint8_t op, std::size_t pos, bool taken) {
+	// Before each instruction, with its opcode and bytecode offset
+	observer.instruction(op, pos);
+	// On each conditional jump and on JumpBegin, with where it is, where it goes if taken, and whether it was
+	observer.jump(pos, pos, taken);
+};
+
+struct NullObserver {
+	void instruction(std::uint8_t, std::size_t) {}
+	void jump(std::size_t, std::size_t, bool) {}
+};
+
+static_assert(Observer<NullObserver>);
+
+} // namespace nori::vm
+
+#endif
@@ -3,6 +3,7 @@
 #define OP_HPP
 
 #include <cstdint>
+#include <string_view>
 
 namespace nori::vm {
 
@@ -29,7 +30,12 @@ namespace nori::vm {
 	X(RandNode, Rand) \
 	X(BitRandNode, BitRand) \
 	X(ByteRandNode, ByteRand) \
-	X(JumpBeginNode, JumpBegin)
+	X(JumpBeginNode, JumpBegin) \
+	X(SumNode, Sum) \
+	X(ProductNode, Product) \
+	X(MinNode, Min) \
+	X(MaxNode, Max) \
+	X(RangeNode, Range)
 
 #define X(_, Op) Op,
 
@@ -42,10 +48,33 @@ enum Op : std::uint8_t {
 	ForwardJumpFalse,
 	BackwardJumpTrue,
 	XNODES_TO_OP
+	// Followed by the arithmetic op to apply to the whole stack
+	Map,
+	// Not an instruction, the number of opcodes
+	OpCount
 };
 
 #undef X
 
+inline constexpr std::string_view
+op_name(std::uint8_t op) {
+	switch (op) {
+	case Return: return "Return";
+	case Push: return "Push";
+	case PushString: return "PushString";
+	case PushVar: return "PushVar";
+	case SetVarPop: return "SetVarPop";
+	case ForwardJumpFalse: return "ForwardJumpFalse";
+	case BackwardJumpTrue: return "BackwardJumpTrue";
+	case Map: return "Map";
+#define X(_, Op) \
+	case Op: return #Op;
+		XNODES_TO_OP
+#undef X
+	default: return "Unknown";
+	}
+}
+
 } // namespace nori::vm
 
 #endif
\ No newline at end of file
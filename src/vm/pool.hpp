@@ -0,0 +1,54 @@
+#pragma once
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace nori::vm {
+
+// Keeps VMs around between runs so their buffers don't have to be allocated again.
+//
+// Not thread safe, meant to be used as a thread_local. Leases go back to the pool when they're destroyed, so nested
+// runs on one thread just get a VM each.
+template <class V>
+class Pool {
+  public:
+	class Lease {
+	  public:
+		Lease(Pool &pool, std::unique_ptr<V> &&vm) : _pool{&pool}, _vm{std::move(vm)} {}
+		Lease(Lease &&) = default;
+		~Lease() {
+			if (_vm)
+				_pool->_free.emplace_back(std::move(_vm));
+		}
+
+		V &operator*() const { return *_vm; }
+		V *operator->() const { return _vm.get(); }
+
+	  private:
+		Pool *_pool;
+		std::unique_ptr<V> _vm;
+	};
+
+	Pool(std::size_t buffer_size) : _buffer_size{buffer_size} {}
+
+	// Hands out an idle VM, creating one if there aren't any. It still needs a reset() before running anything.
+	Lease acquire() {
+		if (_free.empty())
+			return Lease{*this, std::make_unique<V>(_buffer_size)};
+		auto vm = std::move(_free.back());
+		_free.pop_back();
+		return Lease{*this, std::move(vm)};
+	}
+
+  private:
+	std::size_t const _buffer_size;
+	std::vector<std::unique_ptr<V>> _free;
+};
+
+} // namespace nori::vm
+
+#endif
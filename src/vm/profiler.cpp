@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+
+#include <fmt/format.h>
+
+#include "profiler.hpp"
+
+namespace nori::vm {
+
+namespace {
+
+double
+percent(std::uint64_t part, std::uint64_t total) {
+	return total == 0 ? 0.0 : 100.0 * part / total;
+}
+
+} // namespace
+
+std::string
+Profiler::report(std::size_t top) const {
+	std::uint64_t total_count = 0;
+	std::uint64_t total_ticks = 0;
+	std::vector<std::uint8_t> ops{};
+	for (std::uint8_t op = 0; op < OpCount; ++op) {
+		total_count += _ops[op].count;
+		total_ticks += _ops[op].ticks;
+		if (_ops[op].count != 0)
+			ops.emplace_back(op);
+	}
+	std::sort(ops.begin(), ops.end(), [&](auto a, auto b) { return _ops[a].ticks > _ops[b].ticks; });
+
+	std::string out = fmt::format(
+	    "{:<18} {:>12} {:>7} {:>14} {:>7} {:>10}\n", "op", "count", "%", tick_unit, "%", fmt::format("{}/op", tick_unit));
+	for (auto const op : ops) {
+		auto const &stats = _ops[op];
+		out += fmt::format(
+		    "{:<18} {:>12} {:>6.2f}% {:>14} {:>6.2f}% {:>10.1f}\n", op_name(op), stats.count,
+		    percent(stats.count, total_count), stats.ticks, percent(stats.ticks, total_ticks),
+		    static_cast<double>(stats.ticks) / stats.count);
+	}
+	out += fmt::format("{:<18} {:>12} {:>7} {:>14}\n", "total", total_count, "", total_ticks);
+
+	std::vector<std::size_t> offsets(_offsets.size());
+	std::iota(offsets.begin(), offsets.end(), 0);
+	std::erase_if(offsets, [&](auto pos) { return _offsets[pos].hits == 0; });
+	std::sort(offsets.begin(), offsets.end(), [&](auto a, auto b) { return _offsets[a].hits > _offsets[b].hits; });
+	offsets.resize(std::min(offsets.size(), top));
+
+	out += fmt::format("\n{:<10} {:>12} {}\n", "offset", "hits", "op");
+	for (auto const pos : offsets)
+		out += fmt::format("{:<10} {:>12} {}\n", pos, _offsets[pos].hits, op_name(_offsets[pos].op));
+
+	std::vector<std::size_t> loops{};
+	for (std::size_t pos = 0; pos < _back_edges.size(); ++pos) {
+		if (_back_edges[pos].taken != 0)
+			loops.emplace_back(pos);
+	}
+	std::sort(loops.begin(), loops.end(), [&](auto a, auto b) { return _back_edges[a].taken > _back_edges[b].taken; });
+	loops.resize(std::min(loops.size(), top));
+
+	out += fmt::format("\n{:<10} {:>10} {:>12}\n", "loop", "target", "back-edges");
+	for (auto const pos : loops)
+		out += fmt::format("{:<10} {:>10} {:>12}\n", pos, _back_edges[pos].target, _back_edges[pos].taken);
+
+	std::vector<std::tuple<std::uint64_t, std::uint8_t, std::uint8_t>> pairs{};
+	for (std::uint8_t first = 0; first < OpCount; ++first) {
+		for (std::uint8_t second = 0; second < OpCount; ++second) {
+			if (_pairs[first][second] != 0)
+				pairs.emplace_back(_pairs[first][second], first, second);
+		}
+	}
+	std::sort(pairs.begin(), pairs.end(), [](auto const &a, auto const &b) { return std::get<0>(a) > std::get<0>(b); });
+	pairs.resize(std::min(pairs.size(), top));
+
+	out += fmt::format("\n{:<37} {:>12} {:>7}\n", "pair", "count", "%");
+	for (auto const &[count, first, second] : pairs) {
+		out += fmt::format(
+		    "{:<37} {:>12} {:>6.2f}%\n", fmt::format("{} {}", op_name(first), op_name(second)), count,
+		    percent(count, total_count));
+	}
+	return out;
+}
+
+std::string
+Profiler::json() const {
+	std::string out = fmt::format("{{\n  \"tick_unit\": \"{}\",\n  \"ops\": [", tick_unit);
+	char const *sep = "\n";
+	for (std::uint8_t op = 0; op < OpCount; ++op) {
+		if (_ops[op].count == 0)
+			continue;
+		out += fmt::format(
+		    "{}    {{\"op\": \"{}\", \"count\": {}, \"ticks\": {}}}", sep, op_name(op), _ops[op].count, _ops[op].ticks);
+		sep = ",\n";
+	}
+
+	out += "\n  ],\n  \"offsets\": [";
+	sep = "\n";
+	for (std::size_t pos = 0; pos < _offsets.size(); ++pos) {
+		if (_offsets[pos].hits == 0)
+			continue;
+		out += fmt::format(
+		    "{}    {{\"offset\": {}, \"op\": \"{}\", \"hits\": {}}}", sep, pos, op_name(_offsets[pos].op),
+		    _offsets[pos].hits);
+		sep = ",\n";
+	}
+
+	out += "\n  ],\n  \"back_edges\": [";
+	sep = "\n";
+	for (std::size_t pos = 0; pos < _back_edges.size(); ++pos) {
+		if (_back_edges[pos].taken == 0)
+			continue;
+		out += fmt::format(
+		    "{}    {{\"offset\": {}, \"target\": {}, \"taken\": {}}}", sep, pos, _back_edges[pos].target,
+		    _back_edges[pos].taken);
+		sep = ",\n";
+	}
+
+	out += "\n  ],\n  \"pairs\": [";
+	sep = "\n";
+	for (std::uint8_t first = 0; first < OpCount; ++first) {
+		for (std::uint8_t second = 0; second < OpCount; ++second) {
+			if (_pairs[first][second] == 0)
+				continue;
+			out += fmt::format(
+			    "{}    {{\"first\": \"{}\", \"second\": \"{}\", \"count\": {}}}", sep, op_name(first), op_name(second),
+			    _pairs[first][second]);
+			sep = ",\n";
+		}
+	}
+	out += "\n  ]\n}\n";
+	return out;
+}
+
+} // namespace nori::vm
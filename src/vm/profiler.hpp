@@ -0,0 +1,108 @@
+#pragma once
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "observer.hpp"
+#include "op.hpp"
+
+namespace nori::vm {
+
+// Observer counting what a run spends its time on: executions and time per opcode, hits per bytecode offset, taken
+// loop back-edges and which opcodes follow each other (the candidates for superinstructions).
+//
+// An instruction's time is measured from its dispatch to the next one's, in TSC cycles where there's a TSC and in
+// nanoseconds otherwise.
+class Profiler {
+  public:
+#if defined(__x86_64__) || defined(__i386__)
+	static constexpr std::string_view tick_unit = "cycles";
+	static std::uint64_t ticks() { return __rdtsc(); }
+#else
+	static constexpr std::string_view tick_unit = "ns";
+	static std::uint64_t ticks() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		           std::chrono::steady_clock::now().time_since_epoch())
+		    .count();
+	}
+#endif
+
+	struct OpStats {
+		std::uint64_t count = 0;
+		std::uint64_t ticks = 0;
+	};
+
+	struct Offset {
+		std::uint64_t hits = 0;
+		std::uint8_t op = 0;
+	};
+
+	struct BackEdge {
+		std::size_t target = 0;
+		std::uint64_t taken = 0;
+	};
+
+	void instruction(std::uint8_t op, std::size_t pos) {
+		auto const now = ticks();
+		if (op >= OpCount)
+			return;
+		if (_last != OpCount) {
+			_ops[_last].ticks += now - _last_tick;
+			++_pairs[_last][op];
+		}
+		++_ops[op].count;
+
+		if (pos >= _offsets.size())
+			_offsets.resize(pos + 1);
+		++_offsets[pos].hits;
+		_offsets[pos].op = op;
+
+		_last = op;
+		_last_tick = ticks();
+	}
+
+	void jump(std::size_t from, std::size_t to, bool taken) {
+		if (!taken || to > from)
+			return;
+		if (from >= _back_edges.size())
+			_back_edges.resize(from + 1);
+		_back_edges[from].target = to;
+		++_back_edges[from].taken;
+	}
+
+	OpStats const &op(std::uint8_t op) const { return _ops[op]; }
+	std::vector<Offset> const &offsets() const { return _offsets; }
+	// Indexed by the offset of the jump
+	std::vector<BackEdge> const &back_edges() const { return _back_edges; }
+	// How many times `second` ran straight after `first`
+	std::uint64_t pair(std::uint8_t first, std::uint8_t second) const { return _pairs[first][second]; }
+
+	// Human readable summary, hottest first, showing at most `top` rows per section
+	std::string report(std::size_t top = 10) const;
+	std::string json() const;
+
+  private:
+	std::array<OpStats, OpCount> _ops{};
+	std::array<std::array<std::uint64_t, OpCount>, OpCount> _pairs{};
+	std::vector<Offset> _offsets{};
+	std::vector<BackEdge> _back_edges{};
+	std::uint8_t _last = OpCount;
+	std::uint64_t _last_tick = 0;
+};
+
+static_assert(Observer<Profiler>);
+
+} // namespace nori::vm
+
+#endif
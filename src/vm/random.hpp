@@ -0,0 +1,102 @@
+#pragma once
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <random>
+
+namespace nori::vm {
+
+// What the VM needs from a generator for `r`, `b` and `B`
+template <class R>
+concept RandomSource = std::uniform_random_bit_generator<R> && requires(R rng, std::uint64_t seed) {
+	rng.seed(seed, seed);
+	{ rng.bit() } -> std::convertible_to<bool>;
+	{ rng.byte() } -> std::convertible_to<std::uint8_t>;
+};
+
+// xoshiro256**, seeded through splitmix64.
+//
+// 32 bytes of state, so constructing one is free. Different `stream`s for the same seed give independent sequences,
+// which is what parallel runs of one program should use.
+class Rng {
+  public:
+	using result_type = std::uint64_t;
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	void seed(std::uint64_t seed, std::uint64_t stream = 0) {
+		std::uint64_t x = seed ^ splitmix(stream);
+		for (auto &word : _state)
+			word = splitmix(x);
+		_bits = 0;
+		_bits_left = 0;
+	}
+
+	result_type operator()() {
+		auto const result = rotl(_state[1] * 5, 7) * 9;
+		auto const t = _state[1] << 17;
+		_state[2] ^= _state[0];
+		_state[3] ^= _state[1];
+		_state[1] ^= _state[2];
+		_state[0] ^= _state[3];
+		_state[2] ^= t;
+		_state[3] = rotl(_state[3], 45);
+		return result;
+	}
+
+	// Single bits and bytes are handed out from one cached sample instead of drawing a new one each time
+	bool bit() { return take(1); }
+	std::uint8_t byte() { return take(8); }
+
+	// Everything the generator holds, for saving a paused run and picking it up again
+	struct State {
+		std::array<std::uint64_t, 4> words;
+		std::uint64_t bits;
+		unsigned bits_left;
+	};
+
+	State state() const { return State{_state, _bits, _bits_left}; }
+
+	void restore(State const &state) {
+		_state = state.words;
+		_bits = state.bits;
+		_bits_left = state.bits_left;
+	}
+
+  private:
+	// All zero until seed(), which isn't a usable state but makes an unseeded one the same every time
+	std::array<std::uint64_t, 4> _state{};
+	std::uint64_t _bits = 0;
+	unsigned _bits_left = 0;
+
+	static constexpr std::uint64_t rotl(std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	static constexpr std::uint64_t splitmix(std::uint64_t &x) {
+		std::uint64_t z = (x += 0x9e3779b97f4a7c15);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+		return z ^ (z >> 31);
+	}
+
+	std::uint64_t take(unsigned n) {
+		if (_bits_left < n) {
+			_bits = (*this)();
+			_bits_left = 64;
+		}
+		auto const res = _bits & ((std::uint64_t{1} << n) - 1);
+		_bits >>= n;
+		_bits_left -= n;
+		return res;
+	}
+};
+
+static_assert(RandomSource<Rng>);
+
+} // namespace nori::vm
+
+#endif
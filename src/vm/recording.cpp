@@ -0,0 +1,73 @@
+#include <array>
+#include <stdexcept>
+
+#include "random.hpp"
+#include "recording.hpp"
+
+namespace nori::vm {
+
+namespace {
+
+std::uint64_t
+check_value(std::uint64_t seed, std::uint64_t stream) {
+	Rng rng{};
+	rng.seed(seed, stream);
+	return rng();
+}
+
+void
+put_u64(std::ostream &out, std::uint64_t value) {
+	std::array<char, 8> bytes{};
+	for (auto &byte : bytes) {
+		byte = static_cast<char>(value & 0xff);
+		value >>= 8;
+	}
+	out.write(bytes.data(), bytes.size());
+}
+
+std::uint64_t
+get_u64(std::istream &in) {
+	std::array<char, 8> bytes{};
+	if (!in.read(bytes.data(), bytes.size()))
+		throw std::runtime_error{"Recording is truncated"};
+	std::uint64_t value = 0;
+	for (auto it = bytes.rbegin(); it != bytes.rend(); ++it)
+		value = (value << 8) | static_cast<std::uint8_t>(*it);
+	return value;
+}
+
+} // namespace
+
+void
+Recording::write(std::ostream &out) const {
+	out.write(magic.data(), magic.size());
+	out.put(static_cast<char>(version));
+	put_u64(out, seed);
+	put_u64(out, stream);
+	put_u64(out, check_value(seed, stream));
+	put_u64(out, input.size());
+	out.write(input.data(), input.size());
+}
+
+Recording
+Recording::read(std::istream &in) {
+	std::array<char, magic.size() + 1> header{};
+	in.read(header.data(), header.size());
+	if (!in || std::string_view{header.data(), magic.size()} != magic ||
+	    static_cast<std::uint8_t>(header.back()) != version)
+		throw std::runtime_error{"Not a recording, or from a different version"};
+
+	Recording recording{};
+	recording.seed = get_u64(in);
+	recording.stream = get_u64(in);
+	if (get_u64(in) != check_value(recording.seed, recording.stream))
+		throw std::runtime_error{"Recording was made with a different random generator"};
+
+	auto const size = get_u64(in);
+	recording.input.resize(size);
+	if (!in.read(recording.input.data(), size))
+		throw std::runtime_error{"Recording is truncated"};
+	return recording;
+}
+
+} // namespace nori::vm
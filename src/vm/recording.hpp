@@ -0,0 +1,37 @@
+#pragma once
+#ifndef RECORDING_HPP
+#define RECORDING_HPP
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace nori::vm {
+
+// Everything outside the bytecode that decides what a run does: the input its ops consumed and the seed and stream
+// its random ops drew from. Running the same bytecode with these gives the same execution.
+//
+// Random draws aren't logged one by one, the generator is deterministic so the seed stands for all of them. A check
+// value drawn from the generator is stored too, so replaying on a build whose generator changed fails instead of
+// quietly taking a different path.
+//
+// On disk it's the "NORR" magic and a version byte, then the seed, stream, check value and input length as 64 bit
+// little endian integers, then the input.
+struct Recording {
+	static constexpr std::string_view magic = "NORR";
+	static constexpr std::uint8_t version = 1;
+
+	std::uint64_t seed = 0;
+	std::uint64_t stream = 0;
+	std::string input{};
+
+	void write(std::ostream &out) const;
+	// Throws std::runtime_error if it isn't a recording, or was made with a different random generator
+	static Recording read(std::istream &in);
+};
+
+} // namespace nori::vm
+
+#endif
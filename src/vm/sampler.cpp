@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+#include <signal.h>
+#include <sys/time.h>
+
+#include <fmt/format.h>
+
+#include "bytecode.hpp"
+#include "sampler.hpp"
+
+namespace nori::vm {
+
+namespace {
+
+// The sampler the signal handler records into
+std::atomic<Sampler *> active{nullptr};
+struct sigaction previous_action {};
+
+static_assert(std::atomic<std::size_t>::is_always_lock_free, "The signal handler needs lock free atomics");
+
+} // namespace
+
+Sampler::Sampler(std::chrono::microseconds interval, std::size_t max_samples)
+    : _interval{interval}, _samples(max_samples) {}
+
+Sampler::~Sampler() {
+	if (_running)
+		stop();
+}
+
+void
+Sampler::on_signal(int) {
+	auto *const sampler = active.load(std::memory_order_relaxed);
+	if (!sampler)
+		return;
+	auto const index = sampler->_count.fetch_add(1, std::memory_order_relaxed);
+	if (index < sampler->_samples.size())
+		sampler->_samples[index] = sampler->_position.load(std::memory_order_relaxed);
+}
+
+void
+Sampler::start() {
+	Sampler *expected = nullptr;
+	if (!active.compare_exchange_strong(expected, this))
+		throw std::runtime_error{"Another sampler is already running"};
+	_running = true;
+
+	struct sigaction action {};
+	action.sa_handler = on_signal;
+	// The VM could be blocked reading input when the signal arrives
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGPROF, &action, &previous_action);
+
+	itimerval timer{};
+	timer.it_interval.tv_sec = _interval.count() / 1'000'000;
+	timer.it_interval.tv_usec = _interval.count() % 1'000'000;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void
+Sampler::stop() {
+	itimerval timer{};
+	setitimer(ITIMER_PROF, &timer, nullptr);
+	sigaction(SIGPROF, &previous_action, nullptr);
+	active.store(nullptr);
+	_running = false;
+}
+
+std::vector<std::size_t>
+Sampler::samples() const {
+	auto const count = std::min(_count.load(), _samples.size());
+	return {_samples.begin(), _samples.begin() + count};
+}
+
+std::size_t
+Sampler::dropped() const {
+	auto const count = _count.load();
+	return count > _samples.size() ? count - _samples.size() : 0;
+}
+
+std::string
+Sampler::folded(std::string_view bytecode) const {
+	auto const instructions = decode(bytecode);
+	auto const all_loops = loops(instructions);
+
+	std::map<std::size_t, std::size_t> counts{};
+	for (auto const pos : samples())
+		++counts[pos];
+
+	std::map<std::string, std::size_t> stacks{};
+	for (auto const &[pos, count] : counts) {
+		std::string stack = "nori";
+		for (auto const &loop : all_loops) {
+			if (loop.begin <= pos && pos < loop.end)
+				stack += fmt::format(";loop@{}", loop.begin);
+		}
+
+		auto const found = std::lower_bound(
+		    instructions.begin(), instructions.end(), pos, [](auto const &ins, auto pos) { return ins.offset < pos; });
+		if (found != instructions.end() && found->offset == pos)
+			stack += fmt::format(";{}@{}", op_name(found->op), pos);
+		else
+			stack += fmt::format(";@{}", pos);
+		stacks[stack] += count;
+	}
+
+	std::string out{};
+	for (auto const &[stack, count] : stacks)
+		out += fmt::format("{} {}\n", stack, count);
+	return out;
+}
+
+} // namespace nori::vm
@@ -0,0 +1,80 @@
+#pragma once
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "observer.hpp"
+
+namespace nori::vm {
+
+// Sampling profiler. The VM only publishes where it is, and a SIGPROF timer records that position every interval of
+// CPU time, so the cost while running is one store per instruction.
+//
+// Samples are kept in a buffer allocated up front, the signal handler can't allocate. Once it's full further samples
+// are counted as dropped.
+class Sampler {
+  public:
+	// The VM's observer, pointing back at the sampler
+	struct Probe {
+		Sampler *sampler = nullptr;
+
+		void instruction(std::uint8_t, std::size_t pos) { sampler->_position.store(pos, std::memory_order_relaxed); }
+		void jump(std::size_t, std::size_t, bool) {}
+	};
+
+	// Samples every `interval` of CPU time
+	explicit Sampler(
+	    std::chrono::microseconds interval = std::chrono::milliseconds{1}, std::size_t max_samples = 1 << 20);
+	Sampler(Sampler const &) = delete;
+	Sampler &operator=(Sampler const &) = delete;
+	~Sampler();
+
+	Probe probe() { return Probe{this}; }
+
+	// Starts the timer. Only one sampler can run at a time in a process, throws if another one is running.
+	void start();
+	void stop();
+
+	// start() on construction and stop() on destruction, so a run that throws doesn't leave the timer armed
+	class Running {
+	  public:
+		explicit Running(Sampler &sampler) : _sampler{sampler} { _sampler.start(); }
+		Running(Running const &) = delete;
+		Running &operator=(Running const &) = delete;
+		~Running() { _sampler.stop(); }
+
+	  private:
+		Sampler &_sampler;
+	};
+
+	// Bytecode offsets of the instructions that were running, in the order they were sampled
+	std::vector<std::size_t> samples() const;
+	std::size_t dropped() const;
+
+	// Samples as folded stacks for flame graph tools, one `frame;frame;frame count` line per distinct stack. The
+	// frames are the loops enclosing the sampled instruction, outermost first, then the instruction, each labelled
+	// with its bytecode offset.
+	std::string folded(std::string_view bytecode) const;
+
+  private:
+	std::chrono::microseconds _interval;
+	std::atomic<std::size_t> _position{0};
+	std::vector<std::size_t> _samples;
+	std::atomic<std::size_t> _count{0};
+	bool _running = false;
+
+	static void on_signal(int);
+};
+
+static_assert(Observer<Sampler::Probe>);
+
+} // namespace nori::vm
+
+#endif
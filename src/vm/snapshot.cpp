@@ -0,0 +1,89 @@
+#include <bit>
+#include <stdexcept>
+
+#include "snapshot.hpp"
+
+namespace nori::vm {
+
+namespace {
+
+enum ValueType : std::uint8_t {
+	Number,
+	String,
+};
+
+} // namespace
+
+SnapshotWriter::SnapshotWriter(std::string &out) : _out{out} {
+	_out.append(snapshot_magic);
+	u8(snapshot_version);
+}
+
+void
+SnapshotWriter::u64(std::uint64_t value) {
+	for (int i = 0; i < 8; ++i, value >>= 8)
+		u8(static_cast<std::uint8_t>(value & 0xff));
+}
+
+void
+SnapshotWriter::bytes(std::string_view data) {
+	u64(data.size());
+	_out.append(data);
+}
+
+void
+SnapshotWriter::value(NoriValue const &value) {
+	if (auto const *str = std::get_if<std::string>(&value)) {
+		u8(ValueType::String);
+		bytes(*str);
+	} else {
+		u8(ValueType::Number);
+		u64(std::bit_cast<std::uint64_t>(std::get<double>(value)));
+	}
+}
+
+SnapshotReader::SnapshotReader(std::string_view data) : _data{data} {
+	if (!_data.starts_with(snapshot_magic) || _data.size() <= snapshot_magic.size() ||
+	    static_cast<std::uint8_t>(_data[snapshot_magic.size()]) != snapshot_version)
+		throw std::runtime_error{"Not a snapshot, or from a different version"};
+	_pos = snapshot_magic.size() + 1;
+}
+
+std::string_view
+SnapshotReader::take(std::size_t size) {
+	if (_data.size() - _pos < size)
+		throw std::runtime_error{"Snapshot is truncated"};
+	auto const data = _data.substr(_pos, size);
+	_pos += size;
+	return data;
+}
+
+std::uint8_t
+SnapshotReader::u8() {
+	return static_cast<std::uint8_t>(take(1)[0]);
+}
+
+std::uint64_t
+SnapshotReader::u64() {
+	auto const data = take(8);
+	std::uint64_t value = 0;
+	for (auto it = data.rbegin(); it != data.rend(); ++it)
+		value = (value << 8) | static_cast<std::uint8_t>(*it);
+	return value;
+}
+
+std::string_view
+SnapshotReader::bytes() {
+	return take(u64());
+}
+
+NoriValue
+SnapshotReader::value() {
+	switch (u8()) {
+	case ValueType::Number: return std::bit_cast<double>(u64());
+	case ValueType::String: return std::string{bytes()};
+	default: throw std::runtime_error{"Snapshot has a value of unknown type"};
+	}
+}
+
+} // namespace nori::vm
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "../common.hpp"
+
+namespace nori::vm {
+
+// A paused VM's state, written by VM::snapshot() and read back by VM::restore(). It's one flat block of bytes that's
+// parsed where it lies, so it can be restored straight out of a memory mapped file.
+//
+// After the "NORS" magic and a version byte the VM writes its fields in order. Integers are 64 bit little endian,
+// values are a type byte followed by the double's bits or the string's length and bytes.
+inline constexpr std::string_view snapshot_magic = "NORS";
+inline constexpr std::uint8_t snapshot_version = 1;
+
+class SnapshotWriter {
+  public:
+	// Writes the header straight away
+	SnapshotWriter(std::string &out);
+
+	void u8(std::uint8_t value) { _out.push_back(static_cast<char>(value)); }
+	void u64(std::uint64_t value);
+	void bytes(std::string_view data);
+	void value(NoriValue const &value);
+
+  private:
+	std::string &_out;
+};
+
+// Throws std::runtime_error if the snapshot is from a different version or is cut short
+class SnapshotReader {
+  public:
+	// Checks the header
+	SnapshotReader(std::string_view data);
+
+	std::uint8_t u8();
+	std::uint64_t u64();
+	// Only valid as long as the snapshot's data is
+	std::string_view bytes();
+	NoriValue value();
+
+  private:
+	std::string_view _data;
+	std::size_t _pos = 0;
+
+	std::string_view take(std::size_t size);
+};
+
+} // namespace nori::vm
+
+#endif
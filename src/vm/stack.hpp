@@ -0,0 +1,84 @@
+#pragma once
+#ifndef STACK_HPP
+#define STACK_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace nori::vm {
+
+// Double ended stack over a single contiguous buffer.
+//
+// Values live in [_head, _tail) with free space kept on both sides, so pushing onto either end is amortised O(1)
+// like a deque, but clear() keeps the capacity around and the values stay contiguous.
+template <class V>
+class Stack {
+  public:
+	std::size_t size() const { return _tail - _head; }
+	bool empty() const { return _head == _tail; }
+
+	V &operator[](std::size_t i) { return _slots[_head + i]; }
+	V &front() { return _slots[_head]; }
+	V &back() { return _slots[_tail - 1]; }
+
+	V *begin() { return _slots.data() + _head; }
+	V *end() { return _slots.data() + _tail; }
+	V const *begin() const { return _slots.data() + _head; }
+	V const *end() const { return _slots.data() + _tail; }
+
+	template <class... Args>
+	void emplace_back(Args &&...args) {
+		if (_tail == _slots.size())
+			grow();
+		_slots[_tail++] = V(std::forward<Args>(args)...);
+	}
+
+	template <class... Args>
+	void emplace_front(Args &&...args) {
+		if (_head == 0)
+			grow();
+		_slots[--_head] = V(std::forward<Args>(args)...);
+	}
+
+	void pop_back() { --_tail; }
+	void pop_front() { ++_head; }
+
+	// Drops every value but keeps the buffer. The values are reset rather than left where they are, so a stack that's
+	// reused doesn't keep the last run's strings alive.
+	void clear() {
+		std::fill(begin(), end(), V{});
+		_head = _slots.size() / 2;
+		_tail = _head;
+	}
+
+  private:
+	std::vector<V> _slots;
+	std::size_t _head = 0;
+	std::size_t _tail = 0;
+
+	// Recentres the values, reallocating only when they take up more than half the buffer
+	void grow() {
+		std::size_t const count = size();
+		if (count * 2 >= _slots.size()) {
+			std::vector<V> slots(std::max<std::size_t>(16, _slots.size() * 2));
+			std::size_t const head = (slots.size() - count) / 2;
+			std::move(begin(), end(), slots.begin() + head);
+			_slots = std::move(slots);
+			_head = head;
+		} else {
+			std::size_t const head = (_slots.size() - count) / 2;
+			if (head < _head)
+				std::move(begin(), end(), _slots.begin() + head);
+			else
+				std::move_backward(begin(), end(), _slots.begin() + head + count);
+			_head = head;
+		}
+		_tail = _head + count;
+	}
+};
+
+} // namespace nori::vm
+
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <variant>
+
+#include "../common.hpp"
+#include "observer.hpp"
+
+namespace nori::vm {
+
+// Observer counting what a run uses, for sizing buffers and containers from numbers instead of guesses
+struct Stats {
+	std::uint64_t instructions = 0;
+	std::uint64_t values_pushed = 0;
+	std::size_t stack_peak = 0;
+	// Bytes of string data on the stack right now, and the most there was at once
+	std::size_t string_bytes = 0;
+	std::size_t string_bytes_peak = 0;
+	// Strings pushed that were too long for std::string's inline buffer, each one a heap allocation
+	std::uint64_t string_allocations = 0;
+	std::size_t variables = 0;
+	// Blocks of bytecode read into the VM's buffer, the first load included
+	std::uint64_t loads = 0;
+	std::uint64_t bytecode_bytes = 0;
+
+	void instruction(std::uint8_t, std::size_t) { ++instructions; }
+	void jump(std::size_t, std::size_t, bool) {}
+
+	void pushed(NoriValue const &value, std::size_t depth) {
+		++values_pushed;
+		stack_peak = std::max(stack_peak, depth);
+		if (auto const *str = std::get_if<std::string>(&value)) {
+			string_bytes += str->size();
+			string_bytes_peak = std::max(string_bytes_peak, string_bytes);
+			if (str->size() > inline_capacity)
+				++string_allocations;
+		}
+	}
+
+	void popped(NoriValue const &value) {
+		if (auto const *str = std::get_if<std::string>(&value))
+			string_bytes -= str->size();
+	}
+
+	void loaded(std::size_t bytes) {
+		++loads;
+		bytecode_bytes += bytes;
+	}
+
+	void variables_grown(std::size_t count) { variables = count; }
+
+  private:
+	inline static std::size_t const inline_capacity = std::string{}.capacity();
+};
+
+static_assert(Observer<Stats>);
+
+} // namespace nori::vm
+
+#endif
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fmt/format.h>
+
+#include "bytecode.hpp"
+#include "trace.hpp"
+
+namespace nori::vm {
+
+Tracer::Tracer(std::ostream &out) : _out{&out}, _buffer(buffer_size) {
+	_out->write(trace_magic.data(), trace_magic.size());
+	_out->put(static_cast<char>(trace_version));
+}
+
+void
+Tracer::finish() {
+	put(0);
+	put(_last);
+	flush();
+	_out->flush();
+}
+
+void
+Tracer::flush() {
+	// A default constructed tracer has nowhere to write, it just keeps reusing the buffer
+	if (_out)
+		_out->write(_buffer.data(), _used);
+	_buffer.resize(buffer_size);
+	_used = 0;
+}
+
+namespace {
+
+class TraceReader {
+  public:
+	TraceReader(std::istream &trace) : _in{trace} {
+		std::array<char, trace_magic.size() + 1> header{};
+		_in.read(header.data(), header.size());
+		if (!_in || std::string_view{header.data(), trace_magic.size()} != trace_magic ||
+		    static_cast<std::uint8_t>(header.back()) != trace_version)
+			throw std::runtime_error{"Not a trace, or from a different version"};
+	}
+
+	std::uint64_t next() {
+		std::uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			auto const c = _in.get();
+			if (c == std::char_traits<char>::eof())
+				throw std::runtime_error{"Trace ends without an end marker"};
+			++_bytes;
+			value |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+			if (!(c & 0x80))
+				return value;
+		}
+		throw std::runtime_error{"Malformed varint in trace"};
+	}
+
+	std::uint64_t bytes() const { return _bytes + trace_magic.size() + 1; }
+
+  private:
+	std::istream &_in;
+	std::uint64_t _bytes = 0;
+};
+
+// Where execution carries on after the jump at `ins`
+std::size_t
+jump_target(Instruction const &ins, bool taken) {
+	if (!taken)
+		return ins.offset + ins.size;
+	switch (ins.op) {
+	case Op::ForwardJumpFalse: return ins.offset + ins.size + ins.arg;
+	case Op::BackwardJumpTrue: return ins.offset + ins.size - ins.arg;
+	case Op::JumpBegin: return 1;
+	default:
+		throw std::runtime_error{
+		    fmt::format("Trace has a jump at {}, where there's a {}", ins.offset, op_name(ins.op))};
+	}
+}
+
+// Bucket 0 holds 0, bucket n holds [2^(n-1), 2^n)
+std::size_t
+log2_bucket(std::uint64_t value) {
+	return std::bit_width(value);
+}
+
+struct LoopStats {
+	std::uint64_t entries = 0;
+	std::uint64_t iterations = 0;
+	std::uint64_t min = ~std::uint64_t{0};
+	std::uint64_t max = 0;
+	std::array<std::uint64_t, 65> buckets{};
+
+	void record(std::uint64_t trips) {
+		++entries;
+		iterations += trips;
+		min = std::min(min, trips);
+		max = std::max(max, trips);
+		++buckets[log2_bucket(trips)];
+	}
+};
+
+} // namespace
+
+std::string
+summarize_trace(std::istream &trace, std::string_view bytecode, std::size_t top) {
+	TraceReader reader{trace};
+
+	// Straight line runs from one offset up to and including a jump (or the last instruction), and how often each ran.
+	// Trace events only touch this map, the instructions in each run are walked once at the end.
+	std::unordered_map<std::uint64_t, std::uint64_t> runs{};
+	auto const key = [](std::size_t start, std::size_t end) { return (std::uint64_t{start} << 32) | end; };
+
+	// Open loops by the offset of their BackwardJumpTrue, with their trip count so far
+	std::map<std::size_t, LoopStats> loops{};
+	std::vector<std::pair<std::size_t, std::uint64_t>> open{};
+
+	auto const check = [&](std::size_t pos) {
+		if (pos >= bytecode.size())
+			throw std::runtime_error{fmt::format("Trace goes to offset {}, past the end of the bytecode", pos)};
+	};
+
+	std::size_t cur = 1;
+	std::size_t previous = 0;
+	std::uint64_t jumps = 0;
+	while (true) {
+		auto const value = reader.next();
+		if (value == 0) {
+			auto const last = reader.next();
+			check(last);
+			++runs[key(cur, last)];
+			break;
+		}
+
+		auto const zigzag = (value - 1) >> 1;
+		auto const delta = static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+		auto const at = previous + delta;
+		bool const taken = (value - 1) & 1;
+		check(at);
+		if (at < cur)
+			throw std::runtime_error{fmt::format("Trace jumps from {} before reaching it", at)};
+
+		auto const ins = decode_at(bytecode, at);
+		++runs[key(cur, at)];
+		++jumps;
+		previous = at;
+		cur = jump_target(ins, taken);
+		check(cur);
+
+		// A ForwardJumpFalse falling through enters its loop, the matching BackwardJumpTrue decides whether it goes
+		// round again
+		if (ins.op == Op::ForwardJumpFalse) {
+			auto const back = ins.offset + ins.size + ins.arg - 2;
+			if (taken)
+				loops[back].record(0);
+			else
+				open.emplace_back(back, 1);
+		} else if (ins.op == Op::BackwardJumpTrue && !open.empty() && open.back().first == at) {
+			if (taken) {
+				++open.back().second;
+			} else {
+				loops[at].record(open.back().second);
+				open.pop_back();
+			}
+		} else if (ins.op == Op::JumpBegin) {
+			open.clear();
+		}
+	}
+
+	// Expand the runs into instructions
+	std::array<std::uint64_t, OpCount + 1> mix{};
+	std::uint64_t instructions = 0;
+	struct Run {
+		std::size_t start;
+		std::size_t end;
+		std::uint64_t count = 0;
+		std::uint64_t length = 0;
+	};
+	std::vector<Run> hot{};
+	for (auto const &[k, count] : runs) {
+		Run run{.start = static_cast<std::size_t>(k >> 32), .end = static_cast<std::size_t>(k & 0xffffffff)};
+		run.count = count;
+		for (auto pos = run.start; pos <= run.end;) {
+			auto const ins = decode_at(bytecode, pos);
+			++run.length;
+			mix[std::min<std::size_t>(ins.op, OpCount)] += count;
+			pos += ins.size;
+		}
+		instructions += run.length * count;
+		hot.emplace_back(run);
+	}
+
+	std::string out = fmt::format(
+	    "instructions: {}\njumps: {}\ntrace size: {} bytes ({:.2f} bytes per jump)\n", instructions, jumps,
+	    reader.bytes(), jumps == 0 ? 0.0 : static_cast<double>(reader.bytes()) / jumps);
+
+	auto const percent = [&](std::uint64_t part) { return instructions == 0 ? 0.0 : 100.0 * part / instructions; };
+
+	std::vector<std::uint8_t> ops{};
+	for (std::uint8_t op = 0; op <= OpCount; ++op) {
+		if (mix[op] != 0)
+			ops.emplace_back(op);
+	}
+	std::sort(ops.begin(), ops.end(), [&](auto a, auto b) { return mix[a] > mix[b]; });
+	out += fmt::format("\n{:<18} {:>14} {:>7}\n", "op", "count", "%");
+	for (auto const op : ops)
+		out += fmt::format("{:<18} {:>14} {:>6.2f}%\n", op_name(op), mix[op], percent(mix[op]));
+
+	std::sort(
+	    hot.begin(), hot.end(), [](auto const &a, auto const &b) { return a.count * a.length > b.count * b.length; });
+	hot.resize(std::min(hot.size(), top));
+	out += fmt::format("\n{:<15} {:>12} {:>14} {:>7}\n", "path", "length", "runs", "%");
+	for (auto const &run : hot) {
+		out += fmt::format(
+		    "{:<15} {:>12} {:>14} {:>6.2f}%\n", fmt::format("{}-{}", run.start, run.end), run.length, run.count,
+		    percent(run.count * run.length));
+	}
+
+	out += fmt::format(
+	    "\n{:<10} {:>10} {:>14} {:>8} {:>10} {:>10}  {}\n", "loop", "entries", "iterations", "min", "mean", "max",
+	    "trip counts (0, 1, 2-3, 4-7, ...)");
+	for (auto const &[back, stats] : loops) {
+		auto const last = std::find_if(stats.buckets.rbegin(), stats.buckets.rend(), [](auto n) { return n != 0; });
+		std::string buckets{};
+		for (auto it = stats.buckets.begin(); it != last.base(); ++it)
+			buckets += fmt::format("{}{}", buckets.empty() ? "" : " ", *it);
+		// Named by the ForwardJumpFalse, the same as the sampler's loop frames
+		auto const begin = back - decode_at(bytecode, back).arg;
+		out += fmt::format(
+		    "{:<10} {:>10} {:>14} {:>8} {:>10.1f} {:>10}  {}\n", begin, stats.entries, stats.iterations, stats.min,
+		    static_cast<double>(stats.iterations) / stats.entries, stats.max, buckets);
+	}
+	return out;
+}
+
+} // namespace nori::vm
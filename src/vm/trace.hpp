@@ -0,0 +1,82 @@
+#pragma once
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "observer.hpp"
+
+namespace nori::vm {
+
+// Execution trace format. Between jumps the VM runs straight through the bytecode, so recording where each jump was
+// and whether it was taken is enough to replay every instruction that ran, given the bytecode.
+//
+// After the "NORT" magic and a version byte, each ForwardJumpFalse, BackwardJumpTrue and JumpBegin is one LEB128
+// varint: the zigzag encoded distance from the previous jump's offset, shifted left one, with the low bit set if it
+// was taken, plus one. That leaves 0 to mark the end, followed by a varint holding the offset of the last instruction
+// that ran.
+inline constexpr std::string_view trace_magic = "NORT";
+inline constexpr std::uint8_t trace_version = 1;
+
+// Observer writing a trace, through a buffer so the stream is only touched every 64 KiB
+class Tracer {
+  public:
+	static constexpr std::size_t buffer_size = 64 * 1024;
+
+	Tracer() = default;
+	// Writes the header straight away
+	explicit Tracer(std::ostream &out);
+
+	void instruction(std::uint8_t, std::size_t pos) { _last = pos; }
+
+	void jump(std::size_t from, std::size_t, bool taken) {
+		auto const delta = static_cast<std::int64_t>(from - _previous);
+		auto const zigzag = (static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63);
+		put(((zigzag << 1) | taken) + 1);
+		_previous = from;
+		++_jumps;
+	}
+
+	// Writes the end marker and flushes. Nothing can be recorded after this.
+	void finish();
+
+	std::uint64_t jumps() const { return _jumps; }
+
+  private:
+	std::ostream *_out = nullptr;
+	std::vector<char> _buffer{};
+	std::size_t _used = 0;
+	std::size_t _previous = 0;
+	std::size_t _last = 0;
+	std::uint64_t _jumps = 0;
+
+	void put(std::uint64_t value) {
+		if (_buffer.size() - _used < 10)
+			flush();
+		while (value >= 0x80) {
+			_buffer[_used++] = static_cast<char>(value | 0x80);
+			value >>= 7;
+		}
+		_buffer[_used++] = static_cast<char>(value);
+	}
+
+	void flush();
+};
+
+static_assert(Observer<Tracer>);
+
+// Replays a trace against the bytecode it was recorded from, summarising the instruction mix, the hottest straight
+// line paths and how many times each loop went round. Throws std::runtime_error if the trace is malformed or doesn't
+// fit the bytecode.
+std::string
+summarize_trace(std::istream &trace, std::string_view bytecode, std::size_t top = 10);
+
+} // namespace nori::vm
+
+#endif
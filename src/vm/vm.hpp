@@ -2,30 +2,48 @@
 #ifndef NORIVM_HPP
 #define NORIVM_HPP
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <concepts>
 #include <cstdint>
-#include <deque>
 #include <iostream>
 #include <istream>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <random>
+#include <span>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
 
 #include <fmt/format.h>
 
 #include "../common.hpp"
+#include "../hash.hpp"
+#include "error.hpp"
+#include "input.hpp"
+#include "kernels.hpp"
+#include "observer.hpp"
 #include "op.hpp"
+#include "random.hpp"
+#include "snapshot.hpp"
+#include "stack.hpp"
 
 namespace nori::vm {
 
 static_assert(std::numeric_limits<double>::is_iec559, "doubleing point format must be IEEE binary32");
 static_assert(CHAR_BIT == 8, "Bytecode requires chars to be 8 bits");
 
-class InvalidOperandException {};
-class StackException {};
+// Why exec() or resume() returned
+enum class ExecStatus {
+	Finished,
+	// An input op ran out of fed input. resume() retries it once there's more.
+	NeedsInput,
+	// The program hit an error, see error()
+	Failed,
+};
 
 #define XBINOPS \
 	X(Op::Add, [](double const &a, double const &b) { return a + b; }) \
@@ -35,26 +53,164 @@ class StackException {};
 	X(Op::Pow, [](double const &a, double const &b) { return std::pow(a, b); }) \
 	X(Op::Mod, [](double const &a, double const &b) { return a - std::floor(a / b) * b; })
 
-NoriValue floor(NoriValue const &);
-NoriValue ceil(NoriValue const &);
-NoriValue root(NoriValue const &);
+#define XUNOPS \
+	X(Op::Root, [](double const &a) { return std::sqrt(a); }) \
+	X(Op::Ceil, [](double const &a) { return std::ceil(a); }) \
+	X(Op::Floor, [](double const &a) { return std::floor(a); })
+
+// Bulk ops replacing the whole stack with one number, and whether an empty stack is allowed (giving the identity)
+#define XREDUCTIONS \
+	X(Op::Sum, sum, true) \
+	X(Op::Product, product, true) \
+	X(Op::Min, min, false) \
+	X(Op::Max, max, false)
+
 bool truthy(NoriValue const &);
 
-template <std::derived_from<std::basic_istream<char>> T>
+// Most numbers one R can push. Without a stack limit nothing else would stop a huge range before memory ran out.
+inline constexpr std::uint64_t max_range = std::uint64_t{1} << 24;
+
+template <std::derived_from<std::basic_istream<char>> T, RandomSource R = Rng, Observer O = NullObserver>
 class VM {
   public:
-	VM(T &stream, std::size_t buffer_size, std::ostream &output, std::istream &input)
-	    : _stream{stream}, _output{output}, _input{input}, _buffer{new std::uint8_t[buffer_size]},
-	      _buffer_size{buffer_size}, _buffer_offset{0}, _ip{_buffer}, _stack{}, _reversed{false}, _vars{} {
-		load(0);
+	VM(T &stream, std::size_t buffer_size, std::ostream &output, std::istream &input) : VM{buffer_size} {
+		reset(stream, output, input);
 	}
+	// A VM with no program attached, reset() has to be called before exec()
+	VM(std::size_t buffer_size)
+	    : _stream{nullptr}, _output{nullptr}, _input{}, _buffer{new std::uint8_t[buffer_size]},
+	      _buffer_size{buffer_size}, _buffer_offset{0}, _ip{_buffer}, _stack{}, _reversed{false}, _vars{} {}
+	VM(VM const &) = delete;
+	VM &operator=(VM const &) = delete;
 	~VM() { delete[] _buffer; }
-	void exec() {
-		_vars.reserve(*_ip);
+
+	// Starts over with a new program and new input/output, keeping the bytecode buffer and the stack and variable
+	// capacity
+	void reset(T &stream, std::ostream &output, std::istream &input) {
+		_input.reset(input);
+		restart(stream, output);
+	}
+
+	// The same, but input is given through feed_input() instead of read from a stream. When an input op runs out,
+	// exec() and resume() return NeedsInput instead of blocking.
+	void reset(T &stream, std::ostream &output) {
+		_input.reset();
+		restart(stream, output);
+	}
+
+	// Moves on to another program, keeping the stack, the variables, the generator and the input, for running a
+	// program a piece at a time. Its variables have to keep their slots, see IncrementalCompiler. Start it with
+	// exec().
+	void continue_with(T &stream) {
+		_stream = &stream;
+		_error = {};
+		load(0);
+		_ip = _buffer;
+	}
+
+	void feed_input(std::string_view data) { _input.feed(data); }
+	// After this input ops fail at the end of the fed input, the same as at the end of a stream
+	void close_input() { _input.close(); }
+
+	// The observer is left alone by reset(), so it can collect over several runs
+	O &observer() { return _observer; }
+
+	// Appends the input the program consumes to `log`, until the next reset()
+	void record_input(std::string *log) { _input.record(log); }
+
+	// What went wrong, once exec() or resume() has returned Failed
+	Error const &error() const { return _error; }
+
+	// Saves a run paused on NeedsInput: where it is, the stack, the variables, the generator and any input fed but not
+	// consumed yet. restore() picks it up from there.
+	void snapshot(std::string &out) {
+		SnapshotWriter writer{out};
+		writer.u64(program_hash());
+		writer.u64(cur_pos());
+		writer.u8(_reversed);
+		writer.u8(_seeded);
+		// Unseeded, whatever the generator holds is left from an earlier run and restore() doesn't use it
+		auto const rng = _seeded ? _rng.state() : decltype(_rng.state()){};
+		for (auto const word : rng.words)
+			writer.u64(word);
+		writer.u64(rng.bits);
+		writer.u8(rng.bits_left);
+
+		writer.u64(_stack.size());
+		for (auto const &value : _stack)
+			writer.value(value);
+		writer.u64(_vars.size());
+		for (auto const &value : _vars)
+			writer.value(value);
+
+		writer.bytes(_input.pending());
+		writer.u8(_input.failed());
+	}
+
+	// Carries on from a snapshot of the same bytecode, after a reset() of either kind. Input left over in the
+	// snapshot comes before the new input. Continue with resume(), not exec().
+	void restore(std::string_view snapshot) {
+		SnapshotReader reader{snapshot};
+		if (reader.u64() != program_hash())
+			throw std::runtime_error{"Snapshot is of a different program"};
+		auto const pos = reader.u64();
+		_reversed = reader.u8();
+		_seeded = reader.u8();
+		decltype(_rng.state()) rng{};
+		for (auto &word : rng.words)
+			word = reader.u64();
+		rng.bits = reader.u64();
+		rng.bits_left = reader.u8();
+		_rng.restore(rng);
+
+		_stack.clear();
+		for (auto count = reader.u64(); count != 0; --count) {
+			_stack.emplace_back(reader.value());
+			// Passed to the observer like any other push, so the ones keeping track of the stack stay right
+			if constexpr (requires { _observer.pushed(_stack.back(), std::size_t{}); })
+				_observer.pushed(_stack.back(), _stack.size());
+		}
+		_vars.clear();
+		for (auto count = reader.u64(); count != 0; --count)
+			_vars.emplace_back(reader.value());
+
+		auto const pending = reader.bytes();
+		_input.restore(pending, reader.u8());
+
+		load(pos);
+		_ip = _buffer;
+	}
+
+	// Makes r, b and B reproducible. Without a seed the generator is seeded from std::random_device the first time a
+	// random op runs.
+	void seed(std::uint64_t seed, std::uint64_t stream = 0) {
+		_rng.seed(seed, stream);
+		_seeded = true;
+	}
+
+	ExecStatus exec() {
+		// The header has the exact number of slots, so they're allocated once here. A piece carrying on from
+		// another (see continue_with()) keeps the ones it has.
+		if (*_ip > _vars.size()) {
+			_vars.resize(*_ip);
+			if constexpr (requires { _observer.variables_grown(std::size_t{}); })
+				_observer.variables_grown(_vars.size());
+		}
 		advance();
+		return resume();
+	}
+
+	// Carries on after NeedsInput, from the input op that stopped. The observer sees that op again.
+	ExecStatus resume() {
 		while (true) {
+			// Observers like Limiter can't stop the run from inside a hook, they leave a failure here instead
+			if constexpr (requires { _observer.failure(); }) {
+				if (_observer.failure() != ErrorKind::None) [[unlikely]]
+					return fail(_observer.failure());
+			}
+			_observer.instruction(*_ip, cur_pos());
 			switch (*_ip) {
-			case Op::Return: return;
+			case Op::Return: return ExecStatus::Finished;
 
 			case Op::Push:
 				advance();
@@ -85,11 +241,15 @@ class VM {
 				break;
 
 			case Op::Pop:
+				if (_stack.empty())
+					return fail(ErrorKind::StackUnderflow);
 				pop();
 				advance();
 				break;
 
 			case Op::SetVarPop: {
+				if (_stack.empty())
+					return fail(ErrorKind::StackUnderflow);
 				advance();
 				set_var(*_ip, pop());
 				advance();
@@ -97,43 +257,52 @@ class VM {
 			}
 
 			case Op::NumericIn: {
-				double res;
-				if (_input >> res)
-					push(res);
+				auto const res = _input.read_number();
+				if (_input.starved())
+					return ExecStatus::NeedsInput;
+				if (res)
+					push(*res);
 				advance();
 				break;
 			}
 
 			case Op::In: {
-				std::string res;
-				std::getline(_input, res);
-				push(res);
+				auto const line = _input.read_line();
+				if (_input.starved())
+					return ExecStatus::NeedsInput;
+				push(std::string{line});
 				advance();
 				break;
 			}
 
 			case Op::AsciiIn: {
-				char res = _input.get();
+				char res = _input.read_char();
+				if (_input.starved())
+					return ExecStatus::NeedsInput;
 				push(static_cast<double>(res));
 				advance();
 				break;
 			}
 
 			case Op::Out:
-				std::visit([&](auto const &val) { _output << fmt::format("{}", val); }, pop());
+				if (_stack.empty())
+					return fail(ErrorKind::StackUnderflow);
+				std::visit([&](auto const &val) { *_output << fmt::format("{}", val); }, pop());
 				advance();
 				break;
 
 			case Op::AsciiOut:
-				std::visit(
-				    overloaded{
-				        [&](double const &&val) { _output << fmt::format("{}", static_cast<char>(val)); },
-				        [](std::string const &&) { throw std::runtime_error{"Ascii out on string"}; }},
-				    pop());
+				if (_stack.empty())
+					return fail(ErrorKind::StackUnderflow);
+				if (!std::holds_alternative<double>(peek()))
+					return fail(ErrorKind::AsciiOutOnString);
+				*_output << fmt::format("{}", static_cast<char>(std::get<double>(pop())));
 				advance();
 				break;
 
 			case Op::Swap:
+				if (_stack.size() < 2)
+					return fail(ErrorKind::StackUnderflow);
 				swap();
 				advance();
 				break;
@@ -144,6 +313,8 @@ class VM {
 				break;
 
 			case Op::Bury: {
+				if (_stack.empty())
+					return fail(ErrorKind::StackUnderflow);
 				auto const val = pop();
 				reverse();
 				push(val);
@@ -153,22 +324,21 @@ class VM {
 			}
 
 			case Op::Dup:
+				if (_stack.empty())
+					return fail(ErrorKind::StackUnderflow);
 				dup();
 				advance();
 				break;
 
 #define X(OpCode, Fn) \
 	case OpCode: { \
-		if (_stack.size() < 2) { \
-			throw StackException{}; \
-		} \
-		NoriValue &a = peek(1); \
-		NoriValue &b = peek(0); \
-		std::visit( \
-		    overloaded{ \
-		        [&](double const &a_val, double const &b_val) -> void { a.emplace<double>((Fn)(a_val, b_val)); }, \
-		        [](auto, auto) -> void { throw InvalidOperandException{}; }}, \
-		    a, b); \
+		if (_stack.size() < 2) \
+			return fail(ErrorKind::StackUnderflow); \
+		auto *const a = std::get_if<double>(&peek(1)); \
+		auto const *const b = std::get_if<double>(&peek(0)); \
+		if (!a || !b) \
+			return fail(ErrorKind::InvalidOperand); \
+		*a = (Fn)(*a, *b); \
 		pop(); \
 		advance(); \
 		break; \
@@ -177,46 +347,118 @@ class VM {
 				XBINOPS
 #undef X
 
-			case Op::Root:
-				push(root(pop()));
-				advance();
-				break;
+#define X(OpCode, Fn) \
+	case OpCode: { \
+		if (_stack.empty()) \
+			return fail(ErrorKind::StackUnderflow); \
+		auto const *const a = std::get_if<double>(&peek()); \
+		if (!a) \
+			return fail(ErrorKind::InvalidOperand); \
+		auto const result = (Fn)(*a); \
+		pop(); \
+		push(result); \
+		advance(); \
+		break; \
+	}
+
+				XUNOPS
+#undef X
 
-			case Op::Ceil:
-				push(ceil(pop()));
+#define X(OpCode, Kernel, AllowsEmpty) \
+	case OpCode: { \
+		if (!AllowsEmpty && _stack.empty()) \
+			return fail(ErrorKind::StackUnderflow); \
+		if (!gather_numbers()) \
+			return fail(ErrorKind::InvalidOperand); \
+		auto const result = Kernel(std::span<double const>{_numbers}); \
+		clear_stack(); \
+		push(result); \
+		advance(); \
+		break; \
+	}
+
+				XREDUCTIONS
+#undef X
+
+			case Op::Map: {
+				if (_stack.empty())
+					return fail(ErrorKind::StackUnderflow);
+				auto const *const operand = std::get_if<double>(&peek());
+				if (!operand)
+					return fail(ErrorKind::InvalidOperand);
+				auto const constant = *operand;
+				pop();
+				if (!gather_numbers())
+					return fail(ErrorKind::InvalidOperand);
+				advance();
+				if (!apply(_numbers, *_ip, constant))
+					return fail(ErrorKind::UnhandledOpcode);
+				scatter_numbers();
 				advance();
 				break;
+			}
 
-			case Op::Floor:
-				push(floor(pop()));
+			case Op::Range: {
+				if (_stack.size() < 2)
+					return fail(ErrorKind::StackUnderflow);
+				auto const *const from = std::get_if<double>(&peek(1));
+				auto const *const to = std::get_if<double>(&peek(0));
+				if (!from || !to)
+					return fail(ErrorKind::InvalidOperand);
+				auto const start = *from;
+				if (!std::isfinite(start) || !std::isfinite(*to))
+					return fail(ErrorKind::InvalidOperand);
+				// Counted in integers, past 2^53 adding one to a double stops changing it
+				auto const span = *to > start ? std::ceil(*to - start) : 0.0;
+				if (span > static_cast<double>(max_range))
+					return fail(ErrorKind::RangeTooLarge);
+				auto const count = static_cast<std::uint64_t>(span);
+				pop();
+				pop();
+				for (std::uint64_t i = 0; i < count; ++i) {
+					push(start + static_cast<double>(i));
+					// The stack limit can stop it well before max_range
+					if constexpr (requires { _observer.failure(); }) {
+						if (_observer.failure() != ErrorKind::None)
+							break;
+					}
+				}
 				advance();
 				break;
+			}
 
 			case Op::Rand:
-				push(double_dis(rng));
+				push(double_dis(rng()));
 				advance();
 				break;
 
 			case Op::BitRand:
-				push(static_cast<double>(byte_dis(rng) % 2));
+				push(static_cast<double>(rng().bit()));
 				advance();
 				break;
 
 			case Op::ByteRand:
-				push(static_cast<double>(byte_dis(rng) % 256));
+				push(static_cast<double>(rng().byte()));
 				advance();
 				break;
 
 			case Op::JumpBegin:
-				load(0);
+				// Back to the first instruction, past the header
+				_observer.jump(cur_pos(), 1, true);
+				load(1);
 				_ip = _buffer;
 				break;
 
 			case Op::ForwardJumpFalse: {
+				if (_stack.empty())
+					return fail(ErrorKind::StackUnderflow);
+				auto const at = cur_pos();
 				advance();
 				std::uint8_t distance = *_ip;
 				advance();
-				if (!truthy(peek())) {
+				bool const taken = !truthy(peek());
+				_observer.jump(at, cur_pos() + distance, taken);
+				if (taken) {
 					if ((_ip - _buffer) + distance >= _buffer_size) {
 						load(cur_pos() + distance);
 						_ip = _buffer;
@@ -228,10 +470,15 @@ class VM {
 			}
 
 			case Op::BackwardJumpTrue: {
+				if (_stack.empty())
+					return fail(ErrorKind::StackUnderflow);
+				auto const at = cur_pos();
 				advance();
 				std::uint8_t distance = *_ip;
 				advance();
-				if (truthy(peek())) {
+				bool const taken = truthy(peek());
+				_observer.jump(at, cur_pos() - distance, taken);
+				if (taken) {
 					if ((_ip - _buffer) - distance < 0) {
 						load(cur_pos() - distance);
 						_ip = _buffer;
@@ -242,38 +489,74 @@ class VM {
 				break;
 			}
 
-			default:
-				std::stringstream s{};
-				s << "Unhandled opcode " << static_cast<int>(*_ip) << " at " << cur_pos();
-				throw std::runtime_error{std::string{s.str()}};
+			default: return fail(ErrorKind::UnhandledOpcode);
 			}
 		}
 	}
 
   private:
-	T &_stream;
-	std::ostream &_output;
-	std::istream &_input;
+	T *_stream;
+	std::ostream *_output;
+	InputReader _input;
 	std::uint8_t *const _buffer;
 	std::size_t const _buffer_size;
 	std::size_t _buffer_offset;
 	std::uint8_t const *_ip;
-	std::deque<NoriValue> _stack;
+	Stack<NoriValue> _stack;
 	bool _reversed;
 
 	std::vector<NoriValue> _vars;
+	// Scratch space for the bulk ops, the stack's numbers one after another
+	std::vector<double> _numbers;
+	[[no_unique_address]] O _observer;
+	Error _error{};
+
+	// Out of line, so the error path doesn't crowd the dispatch loop
+	[[gnu::noinline, gnu::cold]] ExecStatus fail(ErrorKind kind) {
+		_error = Error{.kind = kind, .pos = cur_pos(), .op = *_ip};
+		return ExecStatus::Failed;
+	}
 
 	// Randomness
 
-	std::random_device device;
-	std::mt19937 rng{device()};
+	R _rng;
+	bool _seeded = false;
 	std::uniform_real_distribution<double> double_dis{
 	    std::numeric_limits<double>::min(), std::numeric_limits<double>::max()};
-	std::uniform_int_distribution<unsigned> byte_dis{
-	    std::numeric_limits<unsigned>::min(), std::numeric_limits<unsigned>::max()};
+
+	R &rng() {
+		if (!_seeded) {
+			std::random_device device;
+			seed((std::uint64_t{device()} << 32) | device());
+		}
+		return _rng;
+	}
+
+	void restart(T &stream, std::ostream &output) {
+		_stream = &stream;
+		_output = &output;
+		_stack.clear();
+		_reversed = false;
+		_vars.clear();
+		_seeded = false;
+		_error = {};
+		load(0);
+		_ip = _buffer;
+	}
 
 	// Bytecode loading
 
+	// Hash of the whole program, so a snapshot can't be restored over a different one
+	std::uint64_t program_hash() {
+		Hasher hasher{};
+		std::array<char, 4096> block;
+		_stream->clear();
+		_stream->seekg(0, std::ios_base::beg);
+		while (_stream->read(block.data(), block.size()) || _stream->gcount() > 0)
+			hasher.update({block.data(), static_cast<std::size_t>(_stream->gcount())});
+		return hasher.digest();
+	}
+
 	void advance() {
 		++_ip;
 		if (_ip >= _buffer + _buffer_size) {
@@ -283,10 +566,12 @@ class VM {
 	}
 
 	void load(std::size_t pos) {
-		_stream.clear();
-		_stream.seekg(pos, std::ios_base::beg);
-		_stream.read(reinterpret_cast<char *>(_buffer), _buffer_size);
+		_stream->clear();
+		_stream->seekg(pos, std::ios_base::beg);
+		_stream->read(reinterpret_cast<char *>(_buffer), _buffer_size);
 		_buffer_offset = pos;
+		if constexpr (requires { _observer.loaded(std::size_t{}); })
+			_observer.loaded(_stream->gcount());
 	}
 
 	std::size_t cur_pos() const { return _buffer_offset + (_ip - _buffer); }
@@ -295,22 +580,24 @@ class VM {
 
 	void push(NoriValue value) {
 		if (_reversed) {
-			_stack.emplace_front(value);
+			_stack.emplace_front(std::move(value));
 		} else {
-			_stack.emplace_back(value);
+			_stack.emplace_back(std::move(value));
 		}
+		if constexpr (requires { _observer.pushed(peek(), std::size_t{}); })
+			_observer.pushed(peek(), _stack.size());
 	}
 
+	// The stack ops below expect the dispatch loop to have checked there are enough values
 	NoriValue pop() {
-		if (_stack.size() == 0) {
-			throw StackException{};
-		}
+		if constexpr (requires { _observer.popped(peek()); })
+			_observer.popped(peek());
 		NoriValue ret_val;
 		if (_reversed) {
-			ret_val = _stack.front();
+			ret_val = std::move(_stack.front());
 			_stack.pop_front();
 		} else {
-			ret_val = _stack.back();
+			ret_val = std::move(_stack.back());
 			_stack.pop_back();
 		}
 		return ret_val;
@@ -320,9 +607,6 @@ class VM {
 	NoriValue &peek(int i) { return _reversed ? _stack[i] : _stack[_stack.size() - 1 - i]; }
 
 	void swap() {
-		if (_stack.size() < 2) {
-			throw StackException{};
-		}
 		if (_reversed) {
 			auto &first = _stack[0];
 			auto &second = _stack[1];
@@ -336,10 +620,40 @@ class VM {
 
 	void reverse() { _reversed = !_reversed; }
 
-	void dup() {
-		if (_stack.size() == 0) {
-			throw StackException{};
+	// Copies the stack into _numbers, bottom first, or returns false if there's a string on it
+	bool gather_numbers() {
+		_numbers.resize(_stack.size());
+		auto out = _numbers.begin();
+		for (auto const &value : _stack) {
+			auto const *const number = std::get_if<double>(&value);
+			if (!number)
+				return false;
+			*out++ = *number;
 		}
+		if (_reversed)
+			std::reverse(_numbers.begin(), _numbers.end());
+		return true;
+	}
+
+	// Puts _numbers back, after gather_numbers()
+	void scatter_numbers() {
+		if (_reversed)
+			std::reverse(_numbers.begin(), _numbers.end());
+		auto in = _numbers.begin();
+		for (auto &value : _stack)
+			value = *in++;
+	}
+
+	// Drops every value, telling the observer about each one
+	void clear_stack() {
+		if constexpr (requires { _observer.popped(peek()); }) {
+			for (auto const &value : _stack)
+				_observer.popped(value);
+		}
+		_stack.clear();
+	}
+
+	void dup() {
 		if (_reversed) {
 			auto first = _stack.front();
 			_stack.emplace_front(first);
@@ -347,6 +661,8 @@ class VM {
 			auto first = _stack.back();
 			_stack.emplace_back(first);
 		}
+		if constexpr (requires { _observer.pushed(peek(), std::size_t{}); })
+			_observer.pushed(peek(), _stack.size());
 	}
 
 	NoriValue get_var(std::uint8_t index) {
@@ -358,10 +674,13 @@ class VM {
 	}
 
 	void set_var(std::uint8_t index, NoriValue value) {
-		if (index >= _vars.size()) {
+		// Only hand written bytecode has slots past the header's count
+		if (index >= _vars.size()) [[unlikely]] {
 			_vars.resize(index + 1);
+			if constexpr (requires { _observer.variables_grown(std::size_t{}); })
+				_observer.variables_grown(_vars.size());
 		}
-		_vars[index] = value;
+		_vars[index] = std::move(value);
 	}
 };
 
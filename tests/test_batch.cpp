@@ -0,0 +1,38 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "test_utils.hpp"
+
+int
+test_batch(int argc, char **const argv) {
+	std::stringstream program{};
+	compile(">0 N [+N] <O", program);
+	auto const bytecode = program.str();
+
+	std::vector<std::string> inputs{};
+	std::vector<BatchJob> jobs{};
+	for (int i = 0; i < 100; ++i)
+		inputs.emplace_back(fmt::format("{} {} 0", i, i));
+	// N fails, so `<` pops the only value and O has nothing left to print
+	inputs.emplace_back("");
+	for (auto const &input : inputs)
+		jobs.emplace_back(BatchJob{.program = bytecode, .input = input});
+
+	auto const results = run_batch(jobs, {}, 4);
+
+	for (int i = 0; i < 100; ++i) {
+		if (results[i].status != 0 || results[i].output != fmt::format("{}", i * 2)) {
+			std::cerr << fmt::format("Job {} gave {} ({})\n", i, results[i].output, results[i].status);
+			return 1;
+		}
+	}
+	if (results.back().status != 1 || results.back().error.empty()) {
+		std::cerr << "Failing job wasn't reported\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "test_utils.hpp"
+
+namespace {
+
+int
+expect_failure(std::string_view source, int status, std::string_view message, RunOptions const &options = {}) {
+	std::stringstream program{};
+	compile(source, program);
+	auto const result = run_memory(program.str(), "", options);
+	if (result.status != status || result.error != message) {
+		std::cerr << fmt::format("{}: expected '{}', got {} '{}'\n", source, message, result.status, result.error);
+		return 1;
+	}
+	return 0;
+}
+
+} // namespace
+
+int
+test_bulk(int argc, char **const argv) {
+	int failures = test_nori_program(">1 >2 >3 >4 >5 S O", "15") + test_nori_program(">1 >6 R P O", "120") +
+	               test_nori_program(">3 >1 >2 m O >3 >1 >2 M O", "13") + test_nori_program("S O P O", "01") +
+	               test_nori_program(">0 >4 R O O O O", "3210") + test_nori_program(">5 >2 R S O", "0") +
+	               test_nori_program(">1 >2 >3 >10 A* S O", "60") + test_nori_program(">5 >7 >3 A% S O", "3") +
+	               test_nori_program(">2 >3 >2 A^ S O", "13");
+
+	// Long enough for the vector loops and a tail
+	failures += test_nori_program(">0 >1003 R >2 A* S O", "1005006") + test_nori_program(">0 >1003 R M O", "1002");
+
+	// Reversed, the op at the top applies and R pushes onto the front
+	failures += test_nori_program(">1 >2 >3 $ >1 A- O O O", "012") + test_nori_program(">9 $ >0 >3 R O O O O", "2109");
+
+	failures += expect_failure(">'a' >1 S", 1, "Attempted to operate on two invalid operands") +
+	            expect_failure(">1 >'a' A+", 1, "Attempted to operate on two invalid operands") +
+	            expect_failure("m", 1, "Stack doesn't contain enough elements") +
+	            expect_failure(">1 R", 1, "Stack doesn't contain enough elements") +
+	            expect_failure(
+	                ">0 >1000000 R", limit_exceeded_status, "Stack limit exceeded", {.limits = {.stack = 100}});
+
+	// Without any limits a huge or endless range is turned down instead of filling memory
+	failures += expect_failure(">0 >10 >10 ^ R", 1, "Range too large") +
+	            expect_failure(">0 >2 >60 ^ - >0 R", 1, "Range too large") +
+	            expect_failure(">0 >1 >0 / R", 1, "Attempted to operate on two invalid operands");
+
+	// A only takes arithmetic
+	std::stringstream program{};
+	try {
+		compile(">1 A O", program);
+		std::cerr << "A followed by O compiled\n";
+		++failures;
+	} catch (nori::parse::UnexpectedTokenError const &) {
+	}
+	return failures;
+}
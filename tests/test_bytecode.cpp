@@ -0,0 +1,36 @@
+#include <iostream>
+#include <sstream>
+
+#include <fmt/core.h>
+
+#include "../src/vm/bytecode.hpp"
+#include "test_utils.hpp"
+
+int
+test_bytecode(int argc, char **const argv) {
+	std::stringstream program{};
+	compile(">3 [>'str' |x|< >|x| [:] >1 -] O", program);
+	auto const bytecode = program.str();
+
+	using namespace nori::vm;
+	auto const instructions = decode(bytecode);
+	auto const found = loops(instructions);
+
+	std::size_t end = 1;
+	for (auto const &ins : instructions) {
+		if (ins.offset != end) {
+			std::cerr << fmt::format("Instruction at {}, expected {}\n", ins.offset, end);
+			return 1;
+		}
+		end += ins.size;
+	}
+
+	// Offsets: header 0, Push 1, ForwardJumpFalse 10, PushString 12, SetVarPop 17, PushVar 19, ForwardJumpFalse 21,
+	// Dup 23, BackwardJumpTrue 24, Push 26, Sub 35, BackwardJumpTrue 36, Out 38, Return 39
+	if (end != bytecode.size() || instructions.back().op != Op::Return || found.size() != 2 ||
+	    found[0].begin != 10 || found[0].end != 38 || found[1].begin != 21 || found[1].end != 26) {
+		std::cerr << fmt::format("Decoded {} of {} bytes, {} loops\n", end, bytecode.size(), found.size());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,108 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include "../src/cache.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+int
+expect(bool ok, std::string_view what) {
+	if (!ok)
+		std::cerr << what << '\n';
+	return !ok;
+}
+
+void
+write_file(std::filesystem::path const &path, std::string_view contents) {
+	std::ofstream fs{path, std::ios_base::binary | std::ios_base::trunc};
+	fs.write(contents.data(), contents.size());
+}
+
+// The cache's entry files, by their .nr extension and hex name
+std::vector<std::filesystem::path>
+entries(std::filesystem::path const &directory) {
+	std::vector<std::filesystem::path> found{};
+	for (auto const &file : std::filesystem::directory_iterator{directory}) {
+		if (file.path().extension() == ".nr" && file.path().stem().string().size() == 16)
+			found.emplace_back(file.path());
+	}
+	return found;
+}
+
+} // namespace
+
+int
+test_cache(int argc, char **const argv) {
+	auto const directory = std::filesystem::temp_directory_path() / fmt::format("nori-cache-test-{}", getpid());
+	std::filesystem::remove_all(directory);
+	int failures = 0;
+
+	{
+		nori::CompileCache cache{directory};
+		failures += expect(!cache.load(">1 O"), "Hit in an empty cache");
+		cache.store(">1 O", "bytecode");
+		failures += expect(cache.load(">1 O") == "bytecode", "Stored bytecode didn't come back");
+		failures += expect(!cache.load(">2 O"), "Hit for a different source");
+
+		auto const stats = cache.stats();
+		failures += expect(stats.hits == 1 && stats.misses == 2, "Stats don't count this cache's loads");
+	}
+
+	// Counts are saved when a cache goes, and added to by the next
+	{
+		nori::CompileCache cache{directory};
+		failures += expect(cache.load(">1 O").has_value(), "Entry didn't outlive its cache");
+		auto const stats = cache.stats();
+		failures += expect(stats.hits == 2 && stats.misses == 2, "Saved stats weren't picked up");
+	}
+
+	// An entry that's been overwritten, cut short or stored for another source is a miss, not wrong bytecode
+	{
+		nori::CompileCache cache{directory};
+		auto const found = entries(directory);
+		failures += expect(found.size() == 1, "Expected one entry file");
+		if (found.size() == 1) {
+			write_file(found.front(), std::string{"NORC"} + std::string(8, '\0') + "stale");
+			failures += expect(!cache.load(">1 O"), "Entry with the wrong check was used");
+			write_file(found.front(), "NOR");
+			failures += expect(!cache.load(">1 O"), "Truncated entry was used");
+		}
+		cache.store(">1 O", "fresh");
+		failures += expect(cache.load(">1 O") == "fresh", "Rewritten entry didn't load");
+	}
+
+	// Clearing only removes what the cache wrote
+	{
+		std::filesystem::create_directories(directory / "results");
+		write_file(directory / "notes.txt", "mine");
+		write_file(directory / "mine.nr", "mine");
+		write_file(directory / "results" / "keep.txt", "mine");
+		write_file(directory / "results" / "0123456789abcdef.res", "result");
+
+		nori::CompileCache cache{directory};
+		cache.clear();
+		failures += expect(entries(directory).empty(), "Entries survived clear()");
+		failures += expect(
+		    !std::filesystem::exists(directory / "results" / "0123456789abcdef.res") &&
+		        !std::filesystem::exists(directory / "stats"),
+		    "Results or stats survived clear()");
+		failures += expect(
+		    std::filesystem::exists(directory / "notes.txt") && std::filesystem::exists(directory / "mine.nr") &&
+		        std::filesystem::exists(directory / "results" / "keep.txt"),
+		    "clear() removed files the cache didn't write");
+		auto const stats = cache.stats();
+		failures += expect(stats.hits == 0 && stats.misses == 0, "Stats weren't reset");
+	}
+
+	std::filesystem::remove_all(directory);
+	return failures;
+}
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "../src/memstream.hpp"
+#include "../src/vm/bytecode.hpp"
+#include "../src/vm/limits.hpp"
+#include "../src/vm/vm.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+using nori::vm::ErrorKind;
+using nori::vm::Op;
+
+// Runs `source` on a VM of its own, checking it fails with `kind` at an `op`
+template <class O = nori::vm::NullObserver>
+int
+expect_error(std::string_view source, ErrorKind kind, Op op, O observer = {}) {
+	std::stringstream compiled{};
+	compile(source, compiled);
+	auto const bytecode = compiled.str();
+
+	nori::MemoryStream program{bytecode};
+	nori::MemoryStream input{""};
+	std::ostringstream output{};
+	nori::vm::VM<nori::MemoryStream, nori::vm::Rng, O> vm{255};
+	vm.observer() = observer;
+	vm.reset(program, output, input);
+
+	auto const status = vm.exec();
+	auto const &error = vm.error();
+	if (status != nori::vm::ExecStatus::Failed || error.kind != kind || error.op != op ||
+	    nori::vm::decode_at(bytecode, error.pos).op != op) {
+		std::cerr << fmt::format(
+		    "{}: expected {} at {}, got '{}' at {}\n", source, static_cast<int>(kind), nori::vm::op_name(op),
+		    nori::vm::error_message(error), error.pos);
+		return 1;
+	}
+	return 0;
+}
+
+} // namespace
+
+int
+test_errors(int argc, char **const argv) {
+	int failures = expect_error(">1 +", ErrorKind::StackUnderflow, Op::Add) +
+	               expect_error(">1 >'a' +", ErrorKind::InvalidOperand, Op::Add) +
+	               expect_error(">'a' z", ErrorKind::InvalidOperand, Op::Root) +
+	               expect_error(">'a' .", ErrorKind::AsciiOutOnString, Op::AsciiOut) +
+	               expect_error(">1 < :", ErrorKind::StackUnderflow, Op::Dup) +
+	               expect_error(">1 @", ErrorKind::StackUnderflow, Op::Swap) +
+	               expect_error("[ ]", ErrorKind::StackUnderflow, Op::ForwardJumpFalse) +
+	               expect_error(">1 [ < ]", ErrorKind::StackUnderflow, Op::BackwardJumpTrue);
+
+	// Limits are noticed before the next instruction, here the loop's back edge
+	failures += expect_error(
+	    ">1 [ >1 ]", ErrorKind::StackLimit, Op::BackwardJumpTrue, nori::vm::Limiter<>{nori::vm::Limits{.stack = 10}});
+
+	// The API reports them the way it always has
+	std::stringstream program{};
+	compile(">1 >'a' +", program);
+	auto const result = run_memory(program.str());
+	if (result.status != 1 || result.error != "Attempted to operate on two invalid operands") {
+		std::cerr << fmt::format("Unexpected result {} '{}'\n", result.status, result.error);
+		++failures;
+	}
+	return failures;
+}
@@ -0,0 +1,10 @@
+#include "test_utils.hpp"
+
+int
+test_input(int argc, char **const argv) {
+	return (
+	    test_nori_program("NNN++O", "6", " 1\n2 +3") + test_nori_program("NOIO", "12 apples", "12 apples\n") +
+	    test_nori_program("N IO", "", "abc\n") + test_nori_program(",O,O,O", "104105-1", "hi") +
+	    test_nori_program("IOIOIO", "firstsecond", "first\nsecond") +
+	    test_nori_program(">0 N [+N] <O", "10", "1 2\n3\n4 0"));
+}
@@ -0,0 +1,46 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "../src/vm/profiler.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+int
+expect_limit(std::string_view source, nori::vm::Limits const &limits, std::string_view message) {
+	std::stringstream program{};
+	compile(source, program);
+	auto const result = run_memory(program.str(), "", RunOptions{.limits = limits});
+	if (result.status != limit_exceeded_status || result.error != message) {
+		std::cerr << fmt::format("{}: expected '{}', got {} '{}'\n", source, message, result.status, result.error);
+		return 1;
+	}
+	return 0;
+}
+
+} // namespace
+
+int
+test_limits(int argc, char **const argv) {
+	int failures = expect_limit(">1 [ ]", {.fuel = 1000}, "Instruction limit exceeded") +
+	               expect_limit(">1 W", {.fuel = 1000}, "Instruction limit exceeded") +
+	               expect_limit(">1 [ >1 ]", {.stack = 100}, "Stack limit exceeded") +
+	               expect_limit(">1 [ >'abc' ]", {.string_bytes = 300}, "String memory limit exceeded") +
+	               expect_limit(">1 [ ]", {.time = std::chrono::milliseconds{10}}, "Time limit exceeded");
+
+	// Under its limits a program runs as usual, hooks included
+	std::stringstream program{};
+	compile(">3 [ >1 - ] >'done' O", program);
+	nori::vm::Profiler profiler{};
+	auto const result = run_memory(
+	    program.str(), "", RunOptions{.profiler = &profiler, .limits = {.fuel = 100, .stack = 3, .string_bytes = 4}});
+	if (result.status != 0 || result.output != "done" || profiler.op(nori::vm::Op::Return).count != 1) {
+		std::cerr << fmt::format("Run within limits failed: {} '{}'\n", result.status, result.error);
+		++failures;
+	}
+	return failures;
+}
@@ -0,0 +1,93 @@
+#include <filesystem>
+#include <iterator>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include "../src/result_cache.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+std::string
+bytecode(std::string_view source) {
+	std::stringstream program{};
+	compile(source, program);
+	return program.str();
+}
+
+int
+expect(bool ok, std::string_view what) {
+	if (!ok)
+		std::cerr << what << '\n';
+	return !ok;
+}
+
+} // namespace
+
+int
+test_memo(int argc, char **const argv) {
+	int failures = 0;
+	auto const echo = bytecode("N |n|< >|n| >|n| * O");
+
+	nori::ResultCache memo{};
+	RunOptions const options{.memo = &memo};
+	auto const first = run_memory(echo, "12", options);
+	auto const second = run_memory(echo, "12", options);
+	auto const other = run_memory(echo, "3", options);
+	failures += expect(first.output == "144" && second.output == "144" && other.output == "9", "Wrong memoized output");
+	auto stats = memo.stats();
+	failures += expect(stats.hits == 1 && stats.misses == 2 && stats.entries == 2, "Expected one hit and two misses");
+
+	// Limits decide how a run ends, so they're part of the key
+	auto const spin = bytecode(">1 [ ]");
+	auto const limited = run_memory(spin, "", RunOptions{.limits = {.fuel = 1000}, .memo = &memo});
+	auto const again = run_memory(spin, "", RunOptions{.limits = {.fuel = 1000}, .memo = &memo});
+	failures += expect(
+	    limited.status == limit_exceeded_status && again.status == limit_exceeded_status &&
+	        again.error == limited.error && memo.stats().hits == 2,
+	    "Limit failures weren't reused");
+
+	// Anything random is always run
+	auto const coin = bytecode(">2 r O");
+	run_memory(coin, "", options);
+	run_memory(coin, "", options);
+	stats = memo.stats();
+	failures += expect(stats.hits == 2 && stats.entries == 3, "A random program was memoized");
+
+	// Room for one result, the older one goes
+	nori::ResultCache small{150};
+	run_memory(echo, "1", RunOptions{.memo = &small});
+	run_memory(echo, "2", RunOptions{.memo = &small});
+	stats = small.stats();
+	failures += expect(stats.evictions == 1 && stats.entries == 1, "Nothing was evicted");
+
+	// Another cache on the same directory picks up what the first one wrote
+	auto const directory = std::filesystem::temp_directory_path() / fmt::format("nori-memo-{}", getpid());
+	{
+		nori::ResultCache writer{nori::ResultCache::default_memory, directory};
+		run_memory(echo, "7", RunOptions{.memo = &writer});
+	}
+	nori::ResultCache reader{nori::ResultCache::default_memory, directory};
+	auto const from_disk = run_memory(echo, "7", RunOptions{.memo = &reader});
+	stats = reader.stats();
+	failures += expect(from_disk.output == "49" && stats.disk_hits == 1, "The result wasn't read back from disk");
+	std::filesystem::remove_all(directory);
+
+	// Room on disk for two results, writing a third removes one
+	{
+		nori::ResultCache trimmed{nori::ResultCache::default_memory, directory, 70};
+		for (auto const input : {"4", "5", "6"})
+			run_memory(echo, input, RunOptions{.memo = &trimmed});
+		auto const files = std::distance(std::filesystem::directory_iterator{directory}, {});
+		failures += expect(files == 2 && trimmed.stats().disk_evictions == 1, "The directory wasn't held to its size");
+	}
+	std::filesystem::remove_all(directory);
+
+	return failures;
+}
@@ -0,0 +1,34 @@
+#include <iostream>
+#include <sstream>
+
+#include <fmt/core.h>
+
+#include "../src/vm/profiler.hpp"
+#include "test_utils.hpp"
+
+int
+test_profile(int argc, char **const argv) {
+	std::stringstream program{};
+	compile(">3 [>1 -] O", program);
+
+	nori::vm::Profiler profiler{};
+	std::stringstream output{};
+	std::stringstream input{};
+	run_stream(program, output, input, RunOptions{.profiler = &profiler});
+
+	using namespace nori::vm;
+	// The loop runs three times and jumps back twice
+	bool const ok = output.str() == "0" && profiler.op(Op::Push).count == 4 && profiler.op(Op::Sub).count == 3 &&
+	                profiler.op(Op::BackwardJumpTrue).count == 3 && profiler.op(Op::Return).count == 1 &&
+	                profiler.pair(Op::Push, Op::Sub) == 3;
+
+	std::size_t back_edges = 0;
+	for (auto const &edge : profiler.back_edges())
+		back_edges += edge.taken;
+
+	if (!ok || back_edges != 2) {
+		std::cerr << fmt::format("Unexpected profile ({} back-edges, output {})\n", back_edges, output.str());
+		return 1;
+	}
+	return 0;
+}
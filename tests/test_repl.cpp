@@ -0,0 +1,77 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "test_utils.hpp"
+
+namespace {
+
+int
+expect(bool ok, std::string_view what) {
+	if (!ok)
+		std::cerr << what << '\n';
+	return !ok;
+}
+
+// Runs a piece that should finish, returning its output
+std::string
+finish(Repl &repl, std::string_view source) {
+	if (repl.run(source) != Repl::State::Finished)
+		std::cerr << fmt::format("'{}' didn't finish: {}\n", source, repl.error());
+	return repl.take_output();
+}
+
+} // namespace
+
+int
+test_repl(int argc, char **const argv) {
+	int failures = 0;
+	Repl repl{};
+
+	// Variables and the stack carry over from one piece to the next
+	finish(repl, ">3 |x|<");
+	failures += expect(finish(repl, ">|x| >4 + O") == "7", "Variable didn't carry over");
+	finish(repl, ">5");
+	failures += expect(finish(repl, ">6 + O") == "11", "Stack didn't carry over");
+	finish(repl, ">2 |y|<");
+	failures += expect(finish(repl, ">|y| >|x| * O") == "6", "Variables got mixed up");
+
+	// A piece that doesn't compile is forgotten, its variables included
+	bool threw = false;
+	try {
+		repl.run(">1 |z|< [");
+	} catch (nori::parse::UnexpectedEndOfInput const &) {
+		threw = true;
+	}
+	failures += expect(threw && repl.variables().size() == 2, "A piece that didn't compile was kept");
+
+	// A failure ends the piece, not the REPL
+	failures += expect(repl.run("+") == Repl::State::Failed && !repl.error().empty(), "Popping nothing didn't fail");
+	failures += expect(finish(repl, ">|x| O") == "3", "Failure wasn't cleared for the next piece");
+
+	// Input ops wait for feeding, and the input carries over too
+	failures += expect(repl.run("N |n|<") == Repl::State::NeedsInput, "Input op didn't wait");
+	failures += expect(repl.feed("12 34\n") == Repl::State::Finished, "Fed piece didn't finish");
+	failures += expect(finish(repl, ">|n| N + O") == "46", "Input didn't carry over");
+
+	threw = false;
+	repl.run("N");
+	try {
+		repl.run(">1 O");
+	} catch (std::runtime_error const &) {
+		threw = true;
+	}
+	failures += expect(threw, "Ran a piece while the last one was waiting for input");
+	failures += expect(repl.close() != Repl::State::NeedsInput, "Closing the input didn't end the waiting piece");
+
+	// Limits apply to each piece on its own
+	Repl limited{RunOptions{.limits = {.fuel = 1000}}};
+	failures += expect(
+	    limited.run(">1 [ ]") == Repl::State::Failed && limited.status() == limit_exceeded_status,
+	    "Limit wasn't applied");
+	failures += expect(finish(limited, ">2 O") == "2", "Limit failure wasn't cleared for the next piece");
+	return failures;
+}
@@ -0,0 +1,33 @@
+#include <iostream>
+#include <sstream>
+
+#include <fmt/core.h>
+
+#include "../src/vm/recording.hpp"
+#include "test_utils.hpp"
+
+int
+test_replay(int argc, char **const argv) {
+	std::stringstream program{};
+	compile("NOIO,O rO bO BO", program);
+	auto const bytecode = program.str();
+
+	nori::vm::Recording recording{};
+	auto const recorded = run_memory(bytecode, "  42 hello\nxyz and more", RunOptions{.record = &recording});
+	if (recording.input != "  42 hello\nx") {
+		std::cerr << fmt::format("Recorded the wrong input: '{}'\n", recording.input);
+		return 1;
+	}
+
+	std::stringstream file{};
+	recording.write(file);
+	auto const loaded = nori::vm::Recording::read(file);
+
+	auto const replayed =
+	    run_memory(bytecode, loaded.input, RunOptions{.seed = loaded.seed, .stream = loaded.stream});
+	if (replayed.output != recorded.output) {
+		std::cerr << fmt::format("Replay gave different output:\n{}\n{}\n", recorded.output, replayed.output);
+		return 1;
+	}
+	return 0;
+}
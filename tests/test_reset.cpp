@@ -0,0 +1,9 @@
+#include "test_utils.hpp"
+
+int
+test_reset(int argc, char **const argv) {
+	// Both runs get the same pooled VM, nothing from the first one may leak into the second
+	return (
+	    test_nori_program(">1>2>3 $ |x|5 >'left over'", "") +
+	    test_nori_program(">|x|O >1>2 OO", "021") + test_nori_program("O", ""));
+}
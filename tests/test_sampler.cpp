@@ -0,0 +1,78 @@
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "../src/vm/sampler.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+// Output that throws on the first write
+class Throwing : public std::streambuf {
+  protected:
+	int_type overflow(int_type) override { throw std::logic_error{"Output failed"}; }
+};
+
+int
+expect(bool ok, std::string_view what) {
+	if (!ok)
+		std::cerr << what << '\n';
+	return !ok;
+}
+
+} // namespace
+
+int
+test_sampler(int argc, char **const argv) {
+	std::stringstream compiled{};
+	compile(">1 [ >1 >2 + < >1 ]", compiled);
+	auto const bytecode = compiled.str();
+
+	int failures = 0;
+	nori::vm::Sampler sampler{std::chrono::microseconds{100}};
+	RunOptions const options{.sampler = &sampler, .limits = {.time = std::chrono::milliseconds{100}}};
+	run_memory(bytecode, "", options);
+	failures += expect(!sampler.samples().empty(), "Nothing was sampled");
+
+	// Every line is `nori;frame;...;frame count`, the loop enclosing what was sampled among the frames
+	auto const folded = sampler.folded(bytecode);
+	std::istringstream lines{folded};
+	std::size_t total = 0;
+	for (std::string line{}; std::getline(lines, line);) {
+		auto const space = line.rfind(' ');
+		auto const stack = line.substr(0, space);
+		auto const count = space == std::string::npos ? 0 : std::stoul(line.substr(space + 1));
+		if (!stack.starts_with("nori;loop@") || stack.find(';', 5) == std::string::npos || count == 0) {
+			std::cerr << fmt::format("Badly folded line '{}'\n", line);
+			++failures;
+		}
+		total += count;
+	}
+	failures += expect(total == sampler.samples().size(), "Folded counts don't add up to the samples");
+
+	// A run that throws still stops the sampler, so the next one can start
+	std::stringstream printing{};
+	compile(">1 O", printing);
+	Throwing buffer{};
+	std::ostream output{&buffer};
+	output.exceptions(std::ios_base::badbit);
+	try {
+		run_memory(printing.str(), "", output, RunOptions{.sampler = &sampler});
+		failures += expect(false, "Writing the output didn't throw");
+	} catch (std::logic_error const &) {
+	}
+	nori::vm::Sampler next{};
+	try {
+		run_memory(bytecode, "", RunOptions{.sampler = &next, .limits = {.fuel = 1000}});
+	} catch (std::runtime_error const &err) {
+		failures += expect(false, err.what());
+	}
+	return failures;
+}
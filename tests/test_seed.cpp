@@ -0,0 +1,25 @@
+#include <iostream>
+
+#include <fmt/core.h>
+
+#include "test_utils.hpp"
+
+int
+test_seed(int argc, char **const argv) {
+	auto const program = "rO bO BO rO";
+
+	auto const first = run_nori_program(program, "", {.seed = 1234});
+	auto const second = run_nori_program(program, "", {.seed = 1234});
+	if (first != second) {
+		std::cerr << fmt::format("Same seed gave different output:\n{}\n{}", first, second);
+		return 1;
+	}
+
+	auto const other_stream = run_nori_program(program, "", {.seed = 1234, .stream = 1});
+	if (first == other_stream) {
+		std::cerr << fmt::format("Different streams gave the same output:\n{}", first);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include "../src/server.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+int
+expect_remote(
+    std::filesystem::path const &socket, std::filesystem::path const &program, std::string const &input,
+    std::string_view expected, int expected_status = 0) {
+	std::ostringstream output{};
+	std::istringstream in{input};
+	auto const status = nori::run_remote(socket, program, output, in);
+	if (status != expected_status || output.str() != expected) {
+		std::cerr << fmt::format("Expected '{}' ({}), got '{}' ({})\n", expected, expected_status, output.str(), status);
+		return 1;
+	}
+	return 0;
+}
+
+// Connects without sending anything
+int
+connect_idle(std::filesystem::path const &socket) {
+	sockaddr_un address{.sun_family = AF_UNIX};
+	socket.native().copy(address.sun_path, sizeof(address.sun_path) - 1);
+	auto const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	::connect(fd, reinterpret_cast<sockaddr const *>(&address), sizeof(address));
+	return fd;
+}
+
+} // namespace
+
+int
+test_serve(int argc, char **const argv) {
+	auto const dir = std::filesystem::temp_directory_path() / fmt::format("nori_serve_{}", ::getpid());
+	std::filesystem::create_directories(dir);
+	auto const socket = dir / "nori.sock";
+	auto const program = dir / "program.nori";
+	std::ofstream{program} << "NN+O";
+
+	int failures = 0;
+	{
+		nori::Server server{socket, 2, {.fuel = 1000}};
+		std::thread serving{[&] { server.serve(); }};
+
+		failures += expect_remote(socket, program, "2 3", "5");
+
+		// Changing the file is picked up on the next run
+		std::ofstream{program} << ">'changed' O";
+		std::filesystem::last_write_time(program, std::filesystem::last_write_time(program) + std::chrono::seconds{1});
+		failures += expect_remote(socket, program, "", "changed");
+
+		// The server's limits hold even if the client doesn't ask for any
+		std::ofstream{program} << ">1 [ ]";
+		std::filesystem::last_write_time(program, std::filesystem::last_write_time(program) + std::chrono::seconds{2});
+		failures += expect_remote(socket, program, "", "", limit_exceeded_status);
+
+		failures += expect_remote(socket, dir / "missing.nori", "", "", 1);
+
+		// Clients that never send their request don't hold up the ones that do
+		std::vector<int> idle{};
+		for (int i = 0; i < 4; ++i)
+			idle.push_back(connect_idle(socket));
+		std::ofstream{program} << "NO";
+		std::filesystem::last_write_time(program, std::filesystem::last_write_time(program) + std::chrono::seconds{3});
+		failures += expect_remote(socket, program, "7", "7");
+
+		// Too much input is turned down, and the server carries on
+		failures += expect_remote(socket, program, std::string((std::size_t{64} << 20) + 1, '1'), "", 1);
+		failures += expect_remote(socket, program, "8", "8");
+
+		if (nori::remote_memo_stats(socket)) {
+			std::cerr << "Got memo stats from a server that isn't memoizing\n";
+			++failures;
+		}
+
+		server.stop();
+		serving.join();
+		for (auto const fd : idle)
+			::close(fd);
+	}
+
+	// The same run twice is answered from the memo the second time
+	{
+		nori::ResultCache memo{};
+		nori::Server server{socket, 2, {}, &memo};
+		std::thread serving{[&] { server.serve(); }};
+		failures += expect_remote(socket, program, "9", "9");
+		failures += expect_remote(socket, program, "9", "9");
+		auto const stats = nori::remote_memo_stats(socket);
+		if (!stats || stats->hits != 1 || stats->misses != 1) {
+			std::cerr << "Wrong memo stats from the server\n";
+			++failures;
+		}
+		server.stop();
+		serving.join();
+	}
+
+	std::filesystem::remove_all(dir);
+	return failures;
+}
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <fmt/core.h>
+
+#include "test_utils.hpp"
+
+namespace {
+
+std::string
+bytecode(std::string_view source) {
+	std::stringstream program{};
+	compile(source, program);
+	return program.str();
+}
+
+} // namespace
+
+int
+test_session(int argc, char **const argv) {
+	Session session{bytecode(">'ready' O NO IO ,O")};
+	std::string output = session.take_output();
+
+	// Input arrives a piece at a time, each op waits until it has all it needs
+	for (auto const piece : {"1", "2 ab", "c\n", "x"}) {
+		if (session.state() != Session::State::NeedsInput) {
+			std::cerr << fmt::format("Finished early, before '{}'\n", piece);
+			return 1;
+		}
+		session.feed(piece);
+		output += session.take_output();
+	}
+	if (session.state() != Session::State::Finished || output != "ready12 abc120") {
+		std::cerr << fmt::format("Unexpected output '{}'\n", output);
+		return 1;
+	}
+
+	// Without a newline the line only ends when the input does
+	Session tail{bytecode("IO IO")};
+	tail.feed("last line");
+	if (tail.state() != Session::State::NeedsInput || tail.close() != Session::State::Finished ||
+	    tail.take_output() != "last line") {
+		std::cerr << "Closing the input didn't end the line\n";
+		return 1;
+	}
+
+	Session failing{bytecode("N +")};
+	if (failing.feed("1 ") != Session::State::Failed || failing.status() != 1 || failing.error().empty()) {
+		std::cerr << "Session didn't fail\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "../src/compile.hpp"
+#include "../src/parse/parse.hpp"
+#include "../src/parse/tokens.hpp"
+#include "../src/vm/op.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+std::string
+bytecode(std::string_view source, bool allocate = true) {
+	nori::parse::Tokens toks{source};
+	auto iter = std::begin(toks);
+	auto const ast = nori::parse::parse(iter, std::end(toks));
+	auto const code = nori::compile(ast, allocate);
+	return {code.begin(), code.end()};
+}
+
+// Runs with and without slot allocation, which can't change what the program does
+int
+same_output(std::string_view source, std::string_view expected) {
+	int failures = 0;
+	for (bool const allocate : {false, true}) {
+		auto const result = run_memory(bytecode(source, allocate), "12 34");
+		if (result.output != expected) {
+			std::cerr << fmt::format(
+			    "'{}' printed '{}' instead of '{}' with allocate={}\n", source, result.output, expected, allocate);
+			++failures;
+		}
+	}
+	return failures;
+}
+
+int
+expect(bool ok, std::string_view what) {
+	if (!ok)
+		std::cerr << what << '\n';
+	return !ok;
+}
+
+} // namespace
+
+int
+test_slots(int argc, char **const argv) {
+	int failures = 0;
+
+	// Variables read before they're stored are 0, sharing a slot mustn't change that
+	failures += same_output(">|u| O |v|7 >|v| O >|u| O", "070");
+	// Loop carried values, and stores only read on the next time round
+	failures += same_output("|i|3 |s|0 >|i| [ >|s| >|i| + |s|< >|i| >1 - : |i|< ] >|s| O", "6");
+	failures += same_output("|p|0 >3 [ >|p| O N |p|< >1 - ] <", "01234");
+	// W carries on with the variables as they are
+	failures += same_output(">|n| >1 + : |n|< O >|n| >3 - [ W ]", "123");
+	failures += same_output("|a|'x' >|a| O |b|'y' >|b| O |a|'z' >|a| O >|b| O", "xyzy");
+	failures += same_output(">5 |dead|< >1 |gone|< |x|2 >|x| O", "2");
+
+	// Stores nothing reads are dropped, popping what they'd have stored
+	auto const dead = bytecode(">1 |x|< |y|2 >3 O");
+	failures += expect(dead.front() == 0, "Dead stores still take a slot");
+	failures += expect(dead.find(static_cast<char>(nori::vm::Op::SetVarPop)) == std::string::npos, "Dead store kept");
+	failures += expect(run_memory(bytecode("|x|< O"), "").status == 1, "Dead store didn't fail on an empty stack");
+
+	// Variables never needed at the same time share, ones that are don't
+	failures += expect(bytecode("|a|1 >|a| O |b|2 >|b| O").front() == 1, "Disjoint variables didn't share a slot");
+	failures += expect(bytecode("|a|1 |b|2 >|a| >|b| + O").front() == 2, "Overlapping variables shared a slot");
+
+	// The variable used in the loop gets slot 0 even though the other one came first. Its store follows the header's
+	// byte and cold's Push.
+	auto const ordered = bytecode("|cold|1 |hot|0 >5 [ >|hot| >1 + |hot|< >1 - ] >|cold| >|hot| + O");
+	failures += expect(ordered.front() == 2 && ordered[11] == 1, "Hot variable didn't get the first slot");
+	return failures;
+}
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <fmt/core.h>
+
+#include "test_utils.hpp"
+
+int
+test_snapshot(int argc, char **const argv) {
+	std::stringstream program{};
+	// Some setup on the stack, reversed, and in a variable, then a random draw once input arrives
+	compile(">'x' >1 >2 $ |v|5 N >|v| + O O O bO", program);
+	auto const bytecode = program.str();
+
+	// Saved half way through reading a number
+	Session setup{bytecode, {.seed = 7}};
+	setup.feed("1");
+	auto const snapshot = setup.snapshot();
+	setup.feed("0 ");
+	auto const expected = setup.take_output();
+
+	auto restored = Session::restore(bytecode, snapshot);
+	restored.feed("0 ");
+	auto const output = restored.take_output();
+	if (restored.state() != Session::State::Finished || output != expected) {
+		std::cerr << fmt::format("Restored session gave '{}', expected '{}'\n", output, expected);
+		return 1;
+	}
+
+	// The same snapshot through run_memory, with its left over input first
+	auto const result = run_memory(bytecode, "0", {.restore = snapshot});
+	if (result.output != expected) {
+		std::cerr << fmt::format("Restored run gave '{}' ({}), expected '{}'\n", result.output, result.error, expected);
+		return 1;
+	}
+
+	// Without a seed nothing random has happened yet, so the same point in the same program saves the same bytes
+	Session first{bytecode};
+	first.feed("1");
+	Session second{bytecode};
+	second.feed("1");
+	if (first.snapshot() != second.snapshot()) {
+		std::cerr << "Snapshots of the same unseeded run differ\n";
+		return 1;
+	}
+
+	std::stringstream other{};
+	compile("N O", other);
+	if (run_memory(other.str(), "1", {.restore = snapshot}).error != "Snapshot is of a different program") {
+		std::cerr << "Restored a snapshot over a different program\n";
+		return 1;
+	}
+	return 0;
+}
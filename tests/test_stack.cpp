@@ -0,0 +1,29 @@
+#include <iostream>
+#include <memory>
+
+#include "../src/vm/stack.hpp"
+#include "test_utils.hpp"
+
+int
+test_stack(int argc, char **const argv) {
+	auto const value = std::make_shared<int>(1);
+	nori::vm::Stack<std::shared_ptr<int>> stack{};
+	for (int i = 0; i < 40; ++i) {
+		stack.emplace_back(value);
+		stack.emplace_front(value);
+	}
+	stack.clear();
+
+	// Cleared values are let go of straight away, not whenever their slot is next written
+	if (!stack.empty() || value.use_count() != 1) {
+		std::cerr << "Cleared stack still holds " << value.use_count() - 1 << " values\n";
+		return 1;
+	}
+
+	stack.emplace_back(value);
+	if (stack.size() != 1 || stack.back() != value) {
+		std::cerr << "Stack isn't usable after clear()\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,29 @@
+#include <iostream>
+#include <sstream>
+
+#include <fmt/core.h>
+
+#include "test_utils.hpp"
+
+int
+test_stats(int argc, char **const argv) {
+	std::stringstream program{};
+	compile(">'a longer string than fifteen' >1 |x|< O >|x| <", program);
+	auto const bytecode = program.str();
+
+	RunStats stats{};
+	auto const result = run_memory(bytecode, "", RunOptions{.stats = &stats});
+
+	auto const &vm = stats.vm;
+	if (result.output != "a longer string than fifteen" || vm.instructions != 7 || vm.values_pushed != 3 ||
+	    vm.stack_peak != 2 || vm.string_bytes_peak != 28 || vm.string_bytes != 0 || vm.string_allocations != 1 ||
+	    vm.variables != 1 || vm.loads != 1 || vm.bytecode_bytes != bytecode.size()) {
+		std::cerr << fmt::format(
+		    "Unexpected stats: {} instructions, {} pushed, peak {}, {} string bytes, {} allocations, {} variables, {} "
+		    "loads of {} bytes\n",
+		    vm.instructions, vm.values_pushed, vm.stack_peak, vm.string_bytes_peak, vm.string_allocations,
+		    vm.variables, vm.loads, vm.bytecode_bytes);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,48 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "../src/compile.hpp"
+#include "../src/parse/parse.hpp"
+#include "../src/parse/tokens.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+// Against parse() and compile() without slot allocation, which the streaming compiler can't do
+int
+same_bytecode(std::string_view source) {
+	nori::parse::Tokens toks{source};
+	auto iter = std::begin(toks);
+	auto const ast = nori::parse::parse(iter, std::end(toks));
+	auto const bytecode = nori::compile(ast, false);
+	std::string const whole{bytecode.begin(), bytecode.end()};
+
+	std::stringstream in{std::string{source}};
+	std::stringstream streamed{};
+	compile_stream(in, streamed);
+
+	if (whole != streamed.str()) {
+		std::cerr << fmt::format("Bytecode differs for {:.60}\n", source);
+		return 1;
+	}
+	return 0;
+}
+
+} // namespace
+
+int
+test_stream_compile(int argc, char **const argv) {
+	// Big enough that tokens, strings and comments land across chunk boundaries
+	std::string big{};
+	for (int i = 0; big.size() < 300'000; ++i)
+		big += fmt::format("|v{}|{} ~~ comment {} ~~ [>'string {}' , >F{}.5 [<]] ", i % 200, i, i, i, i);
+
+	return (
+	    same_bytecode(">72 . >105 . >'!' ,") + same_bytecode("|a|3 |b|'x' >|a| >|b| |a|< [>1 - $ O]") +
+	    same_bytecode("~~ only a comment ~~") + same_bytecode("") + same_bytecode(">0 >10 R >3 A* >2 A% S P m M") +
+	    same_bytecode(big));
+}
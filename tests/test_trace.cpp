@@ -0,0 +1,30 @@
+#include <iostream>
+#include <sstream>
+
+#include <fmt/core.h>
+
+#include "../src/vm/trace.hpp"
+#include "test_utils.hpp"
+
+int
+test_trace(int argc, char **const argv) {
+	std::stringstream program{};
+	compile(">3 [>2 [>1 -] < >1 -] O", program);
+	auto const bytecode = program.str();
+
+	std::stringstream trace{};
+	nori::vm::Tracer tracer{trace};
+	run_memory(bytecode, "", RunOptions{.tracer = &tracer});
+
+	RunStats stats{};
+	run_memory(bytecode, "", RunOptions{.stats = &stats});
+
+	// The replayed trace has to account for every instruction the run executed
+	auto const summary = nori::vm::summarize_trace(trace, bytecode);
+	auto const expected = fmt::format("instructions: {}\n", stats.vm.instructions);
+	if (!summary.starts_with(expected) || tracer.jumps() != 13) {
+		std::cerr << fmt::format("Expected {} and 13 jumps, got {} jumps:\n{}", expected, tracer.jumps(), summary);
+		return 1;
+	}
+	return 0;
+}
@@ -6,17 +6,23 @@
 
 #include "test_utils.hpp"
 
-int
-test_nori_program(std::string_view nori_code, std::string_view expected_output, std::string input) {
+std::string
+run_nori_program(std::string_view nori_code, std::string input, RunOptions const &options) {
 	std::stringstream ss{};
 	compile(nori_code, ss);
 
 	std::stringstream os{};
 	std::stringstream is{input};
-	run_stream(ss, os, is);
+	run_stream(ss, os, is, options);
+	return os.str();
+}
+
+int
+test_nori_program(std::string_view nori_code, std::string_view expected_output, std::string input) {
+	auto const output = run_nori_program(nori_code, input);
 
-	if (os.view() != expected_output) {
-		std::cerr << fmt::format("Expected:\n{}\nGot:\n{}", expected_output, os.view());
+	if (output != expected_output) {
+		std::cerr << fmt::format("Expected:\n{}\nGot:\n{}", expected_output, output);
 		return 1;
 	} else {
 		return 0;
@@ -5,6 +5,10 @@
 #include <string>
 #include <string_view>
 
+#include "../src/api.hpp"
+
+std::string run_nori_program(std::string_view nori_code, std::string input = "", RunOptions const &options = {});
+
 int test_nori_program(std::string_view nori_code, std::string_view expected_output, std::string input = "");
 
 #endif
\ No newline at end of file